@@ -0,0 +1,108 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRACEFUL_CONTROLLER_COST_PYRAMID_HPP
+#define GRACEFUL_CONTROLLER_COST_PYRAMID_HPP
+
+#include <vector>
+
+#include <graceful_controller/cost_grid.hpp>
+
+namespace graceful_controller
+{
+
+/**
+ * @brief Pyramid of the highest costs of a costmap: level 0 holds the cells,
+ * and each cell of level l + 1 the highest cost of the 2 x 2 cells of level l
+ * that it covers.
+ *
+ * A region far from obstacles is then found free with a few lookups in a
+ * coarse level, and only regions next to obstacles are refined, down to
+ * single cells where needed. This makes the common case of a footprint in
+ * open space cheap to accept, before any exact collision check.
+ *
+ * update() keeps a copy of the cells, and only recomputes the coarse cells
+ * above the rows and columns that changed since.
+ */
+class CostPyramid
+{
+public:
+  /**
+   * @param levels Number of levels, including the cells themselves.
+   */
+  explicit CostPyramid(size_t levels = 5);
+
+  /**
+   * @brief Bring the pyramid up to date with the cells of a grid, which also
+   *        sets the grid that positions of isFree() are in.
+   * @returns Number of cells of the coarse levels that were recomputed.
+   */
+  size_t update(const CostGrid& grid);
+
+  /**
+   * @brief Whether every cell of [x_begin, x_end) x [y_begin, y_end), which must be within
+   *        the grid, is below threshold. Exact, whatever the levels that answer it.
+   */
+  bool isBelow(unsigned int x_begin, unsigned int y_begin, unsigned int x_end, unsigned int y_end,
+               unsigned char threshold) const;
+
+  /**
+   * @brief Whether every cell that a footprint within radius of (x, y) can touch is on
+   *        the grid and below threshold, in which case it is not colliding.
+   * @param x, y Position of the robot in the frame of the grid.
+   * @param radius Circumscribed radius of the footprint, after any scaling.
+   */
+  bool isFree(double x, double y, double radius, unsigned char threshold = INSCRIBED_COST) const;
+
+  size_t getLevels() const
+  {
+    return levels_.size();
+  }
+
+  /**
+   * @brief Highest cost of a cell of a level.
+   */
+  unsigned char getCost(size_t level, unsigned int x, unsigned int y) const
+  {
+    return levels_[level].costs[y * levels_[level].size_x + x];
+  }
+
+private:
+  struct Level
+  {
+    unsigned int size_x;
+    unsigned int size_y;
+    std::vector<unsigned char> costs;
+  };
+
+  // Whether the cells of the box under cell (x, y) of a level are below threshold
+  bool isBelow(size_t level, unsigned int x, unsigned int y, unsigned int x_begin, unsigned int y_begin,
+               unsigned int x_end, unsigned int y_end, unsigned char threshold) const;
+
+  std::vector<Level> levels_;
+
+  // The grid of the last update
+  double resolution_;
+  double origin_x_;
+  double origin_y_;
+};
+
+}  // namespace graceful_controller
+
+#endif  // GRACEFUL_CONTROLLER_COST_PYRAMID_HPP
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRACEFUL_CONTROLLER_CURVATURE_TABLE_HPP
+#define GRACEFUL_CONTROLLER_CURVATURE_TABLE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <graceful_controller/graceful_controller.hpp>
+
+namespace graceful_controller
+{
+
+/**
+ * @brief Precomputed curvature of the control law.
+ *
+ * The curvature of the law is k = g(delta, theta2) / r, where g only depends
+ * on the gains k1 and k2. This table samples g on a regular grid over
+ * [-pi, pi] x [-pi, pi], and approach() interpolates it bilinearly. The
+ * velocity limits, beta, lambda and the dependence on r are applied exactly,
+ * so one table serves every velocity cap and r needs no table dimension.
+ *
+ * The interpolation error of g is reported by getMaxError(), the resulting
+ * curvature error is getMaxError() / r.
+ */
+class CurvatureTable
+{
+public:
+  // Used when a controller is constructed with MathBackend::LOOKUP_TABLE but no table
+  static constexpr double DEFAULT_RESOLUTION = 0.01;
+  // Finer resolutions are clamped to this, for a table of about 12.7MB
+  static constexpr double MIN_RESOLUTION = 0.005;
+
+  /**
+   * @brief Build the table, this takes a while for fine resolutions.
+   * @param params Gains of the control law.
+   * @param resolution Spacing of the samples, in radians, at least MIN_RESOLUTION.
+   */
+  CurvatureTable(const ControlLawParameters& params, double resolution);
+
+  /**
+   * @brief Interpolate g(delta, theta2). Both angles should be in [-pi, pi].
+   */
+  double lookup(double delta, double theta2) const
+  {
+    double u = std::min(std::max((delta + M_PI) * inverse_resolution_, 0.0), max_index_);
+    double v = std::min(std::max((theta2 + M_PI) * inverse_resolution_, 0.0), max_index_);
+    int i = std::min(static_cast<int>(u), size_ - 2);
+    int j = std::min(static_cast<int>(v), size_ - 2);
+    u -= i;
+    v -= j;
+    const double* row = &table_[j * size_ + i];
+    double g0 = row[0] + u * (row[1] - row[0]);
+    double g1 = row[size_] + u * (row[size_ + 1] - row[size_]);
+    return g0 + v * (g1 - g0);
+  }
+
+  /**
+   * @brief Get the gains the table was built for.
+   */
+  const ControlLawParameters& getParameters() const
+  {
+    return params_;
+  }
+
+  /**
+   * @brief Get the spacing of the samples, in radians.
+   */
+  double getResolution() const
+  {
+    return resolution_;
+  }
+
+  /**
+   * @brief Get the largest interpolation error of g, measured at the center of every cell.
+   */
+  double getMaxError() const
+  {
+    return max_error_;
+  }
+
+  /**
+   * @brief Get the memory used by the samples, in bytes.
+   */
+  size_t getSizeInBytes() const
+  {
+    return table_.size() * sizeof(double);
+  }
+
+  /**
+   * @brief The exact value of g(delta, theta2).
+   */
+  static double curvatureNumerator(const ControlLawParameters& params, double delta, double theta2);
+
+private:
+  ControlLawParameters params_;
+  double resolution_;
+  double inverse_resolution_;
+  double max_index_;
+  int size_;  // samples per side
+  std::vector<double> table_;
+  double max_error_;
+};
+
+}  // namespace graceful_controller
+
+#endif  // GRACEFUL_CONTROLLER_CURVATURE_TABLE_HPP
@@ -0,0 +1,210 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRACEFUL_CONTROLLER_FAST_MATH_HPP
+#define GRACEFUL_CONTROLLER_FAST_MATH_HPP
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace graceful_controller
+{
+
+/*
+ * Math policies for the control law. Each policy provides the functions
+ * used by GracefulController::approach() as static member functions.
+ */
+
+/**
+ * @brief The standard library implementation.
+ */
+struct ExactMath
+{
+  static double atan(double x) { return std::atan(x); }
+  static double atan2(double y, double x) { return std::atan2(y, x); }
+  static double sin(double x) { return std::sin(x); }
+  static double sqrt(double x) { return std::sqrt(x); }
+  static double pow(double x, double y) { return std::pow(x, y); }
+};
+
+/**
+ * @brief Minimax polynomial approximations with bounded absolute error.
+ *
+ * Worst case errors against libm:
+ *  - atan, atan2: 2.5e-7 rad
+ *  - sin: 3.4e-9 (only approximated for |x| <= pi, which covers the control law)
+ *  - pow: 5e-7 relative for y <= 2, 2.5e-6 relative for y <= 10 (positive normal x)
+ *
+ * sqrt is a single instruction on all supported platforms and is not approximated.
+ */
+struct FastMath
+{
+  static double atan(double x)
+  {
+    // atan(x) = pi/2 - atan(1/x) brings the argument into [0, 1]
+    double ax = std::fabs(x);
+    bool invert = ax > 1.0;
+    double t = invert ? 1.0 / ax : ax;
+    double r = t * atanPolynomial(t * t);
+    if (invert)
+    {
+      r = M_PI_2 - r;
+    }
+    return std::copysign(r, x);
+  }
+
+  static double atan2(double y, double x)
+  {
+    // Reduce to the first octant, then unfold. Signed zeros are
+    // handled the same as std::atan2.
+    double ax = std::fabs(x);
+    double ay = std::fabs(y);
+    double hi = std::max(ax, ay);
+    double t = (hi > 0.0) ? std::min(ax, ay) / hi : 0.0;
+    double r = t * atanPolynomial(t * t);
+    if (ay > ax)
+    {
+      r = M_PI_2 - r;
+    }
+    if (std::signbit(x))
+    {
+      r = M_PI - r;
+    }
+    return std::copysign(r, y);
+  }
+
+  static double sin(double x)
+  {
+    double ax = std::fabs(x);
+    if (!(ax <= M_PI))
+    {
+      // Outside the range of the control law (or NaN)
+      return std::sin(x);
+    }
+    // sin(pi - x) == sin(x) brings the argument into [0, pi/2]
+    if (ax > M_PI_2)
+    {
+      ax = M_PI - ax;
+    }
+    double z = ax * ax;
+    double p = 2.5904885007931373e-06;
+    p = p * z - 0.0001980089776293002;
+    p = p * z + 0.008332899823353973;
+    p = p * z - 0.16666647634639836;
+    p = p * z + 0.9999999765898822;
+    return std::copysign(ax * p, x);
+  }
+
+  static double sqrt(double x)
+  {
+    return std::sqrt(x);
+  }
+
+  static double pow(double x, double y)
+  {
+    static_assert(std::numeric_limits<double>::is_iec559, "FastMath::pow requires IEEE-754 doubles");
+    if (y == 0.0 || !(x >= DBL_MIN && x <= DBL_MAX))
+    {
+      // Zero, subnormal, infinite, negative or NaN
+      return std::pow(x, y);
+    }
+
+    // x = m * 2^e, with m in [sqrt(2)/2, sqrt(2)]
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    int e = static_cast<int>(bits >> 52) - 1023;
+    bits = (bits & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL;
+    double m;
+    std::memcpy(&m, &bits, sizeof(m));
+    if (m > M_SQRT2)
+    {
+      m *= 0.5;
+      ++e;
+    }
+
+    // log2(x) = e + log2(1 + t)
+    double t = m - 1.0;
+    double l = 0.17063450359901025;
+    l = l * t - 0.2726979262147068;
+    l = l * t + 0.29726258673449363;
+    l = l * t - 0.3589618506813568;
+    l = l * t + 0.4804650336772937;
+    l = l * t - 0.7213758714442587;
+    l = l * t + 1.4426997262967767;
+    double log2_x = e + l * t;
+
+    // x^y = 2^n * 2^f, with f in [-0.5, 0.5]
+    double p = y * log2_x;
+    if (p >= 1024.0)
+    {
+      return HUGE_VAL;
+    }
+    if (p < -1022.0)
+    {
+      // Would be subnormal, which is indistinguishable from zero in the control law
+      return 0.0;
+    }
+    int n = static_cast<int>(p < 0.0 ? p - 0.5 : p + 0.5);
+    double f = p - n;
+    double r = 0.0013276471979286704;
+    r = r * f + 0.009675541334209831;
+    r = r * f + 0.05550713273543075;
+    r = r * f + 0.2402211972384865;
+    r = r * f + 0.693146967064733;
+    r = r * f + 1.0000000716546822;
+
+    // Scale by 2^n, n may be 1024 here so this is done in two steps
+    int n1 = n / 2;
+    return r * exp2i(n1) * exp2i(n - n1);
+  }
+
+private:
+  /**
+   * @brief atan(x) / x, in terms of x^2, for |x| <= 1.
+   */
+  static double atanPolynomial(double z)
+  {
+    double p = 0.006811792826621242;
+    p = p * z - 0.03360421908906167;
+    p = p * z + 0.07962367055353373;
+    p = p * z - 0.13233341987579095;
+    p = p * z + 0.19807815532904086;
+    p = p * z - 0.33317368050431867;
+    return p * z + 0.9999961115476742;
+  }
+
+  /**
+   * @brief 2^n for n in [-1022, 1023].
+   */
+  static double exp2i(int n)
+  {
+    uint64_t bits = static_cast<uint64_t>(n + 1023) << 52;
+    double result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+  }
+};
+
+}  // namespace graceful_controller
+
+#endif  // GRACEFUL_CONTROLLER_FAST_MATH_HPP
@@ -0,0 +1,194 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRACEFUL_CONTROLLER_FOOTPRINT_TEMPLATES_HPP
+#define GRACEFUL_CONTROLLER_FOOTPRINT_TEMPLATES_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include <graceful_controller/cost_grid.hpp>
+
+namespace graceful_controller
+{
+
+/**
+ * @brief A vertex of a footprint polygon, relative to the robot.
+ */
+struct Point2D
+{
+  double x;
+  double y;
+};
+
+/**
+ * @brief Consecutive cells of one row of a footprint template, relative to
+ * the cell of the robot.
+ */
+struct FootprintSpan
+{
+  int dy;
+  int x_begin;
+  int x_end;  // one past the last cell
+};
+
+/**
+ * @brief Axis aligned rectangle of cells, relative to the cell of the robot.
+ */
+struct FootprintRectangle
+{
+  int x_begin;
+  int x_end;  // one past the last cell
+  int y_begin;
+  int y_end;  // one past the last row
+};
+
+/**
+ * @brief Footprint boundaries rasterized ahead of time, so that a collision
+ * check only has to look up the costs of a list of cells.
+ *
+ * There is one template per yaw bin and footprint scaling level. A template
+ * holds the cells, relative to the cell of the robot, that the boundary of the
+ * footprint can touch for any heading in its bin, any position of the robot
+ * within its cell, and any scaling between the previous level and its own. It
+ * is therefore conservative: whenever the exact boundary crosses a cell, that
+ * cell is checked, along with neighbours up to a few cells away (more with
+ * widely spaced scaling levels).
+ *
+ * Filled templates also hold the cells inside the footprint: each row is one
+ * span, from the first to the last cell of the boundary in that row. This
+ * catches obstacles inside a footprint that is larger than the inflation of
+ * the costmap, and costs little more, as rows are scanned many cells at a time.
+ *
+ * Each template is also covered by a few rectangles, which together hold
+ * every cell of the filled template, and as few others as possible. They are
+ * meant for lookups that answer a whole rectangle at once, such as a summed
+ * area table.
+ *
+ * Templates only hold for the resolution they were built for, rebuild them
+ * when it or the footprint changes.
+ */
+class FootprintTemplates
+{
+public:
+  /**
+   * @brief Rasterize the templates, this takes a while for fine resolutions.
+   * @param footprint Vertices of the footprint polygon, relative to the robot.
+   * @param resolution Size of the cells of the costmap.
+   * @param yaw_bins Number of bins the headings are split into.
+   * @param max_scaling Largest footprint scaling that will be checked.
+   * @param scaling_step Spacing of the scaling levels, from 1.0 up to max_scaling.
+   * @param filled Whether to also hold the cells inside the footprint.
+   * @param max_rectangles Most rectangles covering each template.
+   */
+  FootprintTemplates(const std::vector<Point2D>& footprint, double resolution, size_t yaw_bins,
+                     double max_scaling, double scaling_step, bool filled = false, size_t max_rectangles = 4);
+
+  /**
+   * @brief Collision check the footprint at a pose: a cell of its template at
+   *        or above threshold, or off the grid, is a collision.
+   * @param grid Costs, at the resolution of the templates.
+   * @param x, y, yaw Pose of the robot in the frame of the grid.
+   * @param scaling Ratio to expand the footprint by, at most getMaxScaling().
+   */
+  bool isColliding(const CostGrid& grid, double x, double y, double yaw, double scaling,
+                   unsigned char threshold = LETHAL_COST) const;
+
+  /**
+   * @brief Get the template of a heading and scaling, as spans sorted by row.
+   * @param count Returned number of spans.
+   */
+  const FootprintSpan* getSpans(double yaw, double scaling, size_t& count) const;
+
+  /**
+   * @brief Get the rectangles covering the filled template of a heading and scaling.
+   * @param count Returned number of rectangles, at least 1.
+   */
+  const FootprintRectangle* getRectangles(double yaw, double scaling, size_t& count) const;
+
+  const std::vector<Point2D>& getFootprint() const
+  {
+    return footprint_;
+  }
+
+  double getResolution() const
+  {
+    return resolution_;
+  }
+
+  size_t getYawBins() const
+  {
+    return yaw_bins_;
+  }
+
+  double getScalingStep() const
+  {
+    return scaling_step_;
+  }
+
+  bool isFilled() const
+  {
+    return filled_;
+  }
+
+  /**
+   * @brief Get the scaling of the top level, which is at least the max_scaling
+   *        the templates were built for.
+   */
+  double getMaxScaling() const
+  {
+    return 1.0 + (levels_ - 1) * scaling_step_;
+  }
+
+  /**
+   * @brief Get the memory used by the templates, in bytes.
+   */
+  size_t getSizeInBytes() const
+  {
+    return spans_.size() * sizeof(FootprintSpan) + offsets_.size() * sizeof(size_t) +
+           rectangles_.size() * sizeof(FootprintRectangle) + rectangle_offsets_.size() * sizeof(size_t);
+  }
+
+private:
+  // Index of the template of a heading and scaling
+  size_t index(double yaw, double scaling) const;
+
+  // Rasterize the template of one level and yaw bin into spans_, using cells as scratch space
+  void build(size_t level, size_t bin, std::vector<unsigned char>& cells);
+
+  // Cover the rows of the last template built with rectangles_
+  void buildRectangles();
+
+  std::vector<Point2D> footprint_;
+  double resolution_;
+  size_t yaw_bins_;
+  double scaling_step_;
+  bool filled_;
+  size_t max_rectangles_;
+  size_t levels_;
+
+  std::vector<FootprintSpan> spans_;
+  std::vector<size_t> offsets_;  // first span of each template, and the end of the last
+  std::vector<FootprintRectangle> rectangles_;
+  std::vector<size_t> rectangle_offsets_;  // the same, for rectangles_
+};
+
+}  // namespace graceful_controller
+
+#endif  // GRACEFUL_CONTROLLER_FOOTPRINT_TEMPLATES_HPP
@@ -20,12 +20,219 @@
 #ifndef GRACEFUL_CONTROLLER_HPP
 #define GRACEFUL_CONTROLLER_HPP
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <memory>
 #include <vector>
 
+#include <angles/angles.h>
+#include <graceful_controller/fast_math.hpp>
+
 namespace graceful_controller
 {
 
+/**
+ * @brief Selects the implementation of the math functions used by the control law.
+ */
+enum class MathBackend
+{
+  EXACT,         // Standard library, see ExactMath
+  APPROXIMATE,   // Polynomial approximations, see FastMath for error bounds
+  LOOKUP_TABLE   // Interpolated curvature, see CurvatureTable for error bounds
+};
+
+class CurvatureTable;
+using CurvatureTablePtr = std::shared_ptr<const CurvatureTable>;
+
+/**
+ * @brief Kernels for pow(|k|, lambda). Integer and half-integer
+ *        exponents only need a few multiplies and (maybe) a sqrt.
+ */
+enum class LambdaKernel
+{
+  ONE,
+  TWO,
+  THREE,
+  INTEGER,
+  HALF_INTEGER,
+  GENERIC
+};
+
+/**
+ * @brief Gains of the control law, see GracefulController for a description of each.
+ */
+struct ControlLawParameters
+{
+  ControlLawParameters(double k1, double k2, double max_decel, double beta, double lambda)
+    : k1(k1), k2(k2), max_decel(max_decel), beta(beta), lambda(lambda), lambda_integer(0)
+  {
+    // Select a specialized kernel for common exponents (the default is 2.0)
+    double twice_lambda = 2.0 * lambda;
+    if (lambda == 1.0)
+    {
+      lambda_kernel = LambdaKernel::ONE;
+    }
+    else if (lambda == 2.0)
+    {
+      lambda_kernel = LambdaKernel::TWO;
+    }
+    else if (lambda == 3.0)
+    {
+      lambda_kernel = LambdaKernel::THREE;
+    }
+    else if (lambda < 0.0 || lambda > 64.0 || twice_lambda != std::floor(twice_lambda))
+    {
+      lambda_kernel = LambdaKernel::GENERIC;
+    }
+    else
+    {
+      lambda_integer = static_cast<int>(std::floor(lambda));
+      lambda_kernel = (lambda == lambda_integer) ? LambdaKernel::INTEGER : LambdaKernel::HALF_INTEGER;
+    }
+  }
+
+  double k1;
+  double k2;
+  double max_decel;
+  double beta;
+  double lambda;
+  LambdaKernel lambda_kernel;
+  int lambda_integer;  // integer part of lambda, for the INTEGER and HALF_INTEGER kernels
+};
+
+/**
+ * @brief Limits on the velocities produced by the control law.
+ */
+struct VelocityLimits
+{
+  double min_abs_velocity;
+  double max_abs_velocity;
+  double max_abs_angular_velocity;
+};
+
+/**
+ * @brief Computes x^n for n >= 0 by repeated squaring.
+ */
+inline double integerPower(double x, int n)
+{
+  double result = 1.0;
+  while (n > 0)
+  {
+    if (n & 1)
+    {
+      result *= x;
+    }
+    x *= x;
+    n >>= 1;
+  }
+  return result;
+}
+
+/**
+ * @brief Computes pow(abs_k, lambda) with the kernel selected for these parameters.
+ */
+template <typename Math>
+inline double curvatureTerm(const ControlLawParameters& params, double abs_k)
+{
+  switch (params.lambda_kernel)
+  {
+    case LambdaKernel::ONE:
+      return abs_k;
+    case LambdaKernel::TWO:
+      return abs_k * abs_k;
+    case LambdaKernel::THREE:
+      return abs_k * abs_k * abs_k;
+    case LambdaKernel::INTEGER:
+      return integerPower(abs_k, params.lambda_integer);
+    case LambdaKernel::HALF_INTEGER:
+      return Math::sqrt(abs_k) * integerPower(abs_k, params.lambda_integer);
+    default:
+      return Math::pow(abs_k, params.lambda);
+  }
+}
+
+/**
+ * @brief Velocities of the control law, once the curvature is known.
+ * @tparam Math The math policy, ExactMath or FastMath.
+ * @param params Gains of the control law.
+ * @param limits Velocity limits.
+ * @param r Distance to the goal.
+ * @param k Curvature of the path towards the goal.
+ * @param vel_x The computed command velocity in the linear direction.
+ * @param vel_th The computed command velocity in the angular direction.
+ * @param backward_motion Flag to indicate that the robot should move backward.
+ * @returns true if there is a solution.
+ */
+template <typename Math = ExactMath>
+inline bool approachCurvature(const ControlLawParameters& params, const VelocityLimits& limits,
+                              double r, double k, double& vel_x, double& vel_th, bool backward_motion = false)
+{
+  // Compute max_velocity based on curvature
+  double v = limits.max_abs_velocity / (1 + params.beta * curvatureTerm<Math>(params, std::fabs(k)));
+  // Limit velocity based on approaching target
+  double approach_limit = Math::sqrt(2 * params.max_decel * r);
+  v = std::min(v, approach_limit);
+  v = std::min(std::max(v, limits.min_abs_velocity), limits.max_abs_velocity);
+  if (backward_motion)
+  {
+    v *= -1; // reverse linear velocity direction for backward motion
+  }
+
+  // Compute angular velocity
+  double w = k * v;
+  // Bound angular velocity
+  double bounded_w = std::min(limits.max_abs_angular_velocity, std::max(-limits.max_abs_angular_velocity, w));
+  // Make sure that if we reduce w, we reduce v so that kurvature is still followed
+  if (w != 0.0)
+  {
+    v *= (bounded_w/w);
+  }
+
+  // Send command to base
+  vel_x = v;
+  vel_th = bounded_w;
+  return true;
+}
+
+/**
+ * @brief The control law behind GracefulController::approach(). This is
+ * defined in the header so that it can be inlined into simulation loops,
+ * where parameters and backward_motion are usually loop invariant.
+ * @tparam Math The math policy, ExactMath or FastMath.
+ * @param params Gains of the control law.
+ * @param limits Velocity limits.
+ * @param x The x coordinate of the goal, relative to robot base link.
+ * @param y The y coordinate of the goal, relative to robot base link.
+ * @param theta The angular orientation of the goal, relative to robot base link.
+ * @param vel_x The computed command velocity in the linear direction.
+ * @param vel_th The computed command velocity in the angular direction.
+ * @param backward_motion Flag to indicate that the robot should move backward.
+ * @returns true if there is a solution.
+ */
+template <typename Math = ExactMath>
+inline bool approachKernel(const ControlLawParameters& params, const VelocityLimits& limits,
+                           double x, double y, double theta,
+                           double& vel_x, double& vel_th, bool backward_motion = false)
+{
+  // Distance to goal
+  double r = Math::sqrt(x * x + y * y);
+
+  // Orientation base frame relative to r_
+  double delta = (backward_motion) ? Math::atan2(-y, -x) : Math::atan2(-y, x);
+
+  // Determine orientation of goal frame relative to r_
+  double theta2 = angles::normalize_angle(theta + delta);
+
+  // Compute the virtual control
+  double k1 = params.k1;
+  double a = Math::atan(-k1 * theta2);
+  // Compute curvature (k)
+  double k = -1.0/r * (params.k2 * (delta - a) + (1 + (k1/(1+((k1*theta2)*(k1*theta2)))))*Math::sin(delta));
+
+  return approachCurvature<Math>(params, limits, r, k, vel_x, vel_th, backward_motion);
+}
+
 class GracefulController
 {
 public:
@@ -37,6 +244,10 @@ public:
    * @param max_abs_velocity The maximum absolute velocity in the linear direction.
    * @param max_decel The maximum deceleration in the linear direction.
    * @param max_abs_angular_velocity The maximum absolute velocity in the angular direction.
+   * @param beta How fast velocity drops as curvature increases.
+   * @param lambda Exponent of the curvature when computing velocity.
+   * @param math_backend Implementation of atan, atan2, sin and pow used by approach().
+   *        For MathBackend::LOOKUP_TABLE, a table of the default resolution is built.
    */
   GracefulController(double k1,
                      double k2,
@@ -45,12 +256,35 @@ public:
                      double max_decel,
                      double max_abs_angular_velocity,
                      double beta,
-                     double lambda);
+                     double lambda,
+                     MathBackend math_backend = MathBackend::EXACT);
+
+  /**
+   * @brief Constructor of the controller.
+   * @param params Gains of the control law.
+   * @param limits Default velocity limits, used by the overloads of approach()
+   *               and approachBatch() that do not take limits.
+   * @param math_backend Implementation of atan, atan2, sin and pow used by approach().
+   *        For MathBackend::LOOKUP_TABLE, a table of the default resolution is built.
+   */
+  GracefulController(const ControlLawParameters& params,
+                     const VelocityLimits& limits,
+                     MathBackend math_backend = MathBackend::EXACT);
+
+  /**
+   * @brief Constructor of a controller using MathBackend::LOOKUP_TABLE.
+   * @param table Precomputed curvature, which also provides the gains.
+   * @param limits Default velocity limits, used by the overloads of approach()
+   *               and approachBatch() that do not take limits.
+   */
+  GracefulController(const CurvatureTablePtr& table,
+                     const VelocityLimits& limits);
 
   /**
    * @brief Implements something loosely based on "A Smooth Control Law for
    * Graceful Motion of Differential Wheeled Mobile Robots in 2D Environments"
-   * by Park and Kuipers, ICRA 2011
+   * by Park and Kuipers, ICRA 2011. This is an out-of-line wrapper around
+   * approachKernel().
    * @param x The x coordinate of the goal, relative to robot base link.
    * @param y The y coordinate of the goal, relative to robot base link.
    * @param theta The angular orientation of the goal, relative to robot base link.
@@ -60,10 +294,82 @@ public:
    * @returns true if there is a solution.
    */
   bool approach(const double x, const double y, const double theta,
-                double& vel_x, double& vel_th, bool backward_motion=false);
+                double& vel_x, double& vel_th, bool backward_motion=false) const;
+
+  /**
+   * @brief Same as above, but with the velocity limits given per call
+   * rather than taken from the controller. The controller is not modified,
+   * so any number of threads can share one instance.
+   * @param x The x coordinate of the goal, relative to robot base link.
+   * @param y The y coordinate of the goal, relative to robot base link.
+   * @param theta The angular orientation of the goal, relative to robot base link.
+   * @param limits Velocity limits for this evaluation.
+   * @param vel_x The computed command velocity in the linear direction.
+   * @param vel_th The computed command velocity in the angular direction.
+   * @param backward_motion Flag to indicate that the robot should move backward. False by default.
+   * @returns true if there is a solution.
+   */
+  bool approach(const double x, const double y, const double theta, const VelocityLimits& limits,
+                double& vel_x, double& vel_th, bool backward_motion=false) const;
 
   /**
-   * @brief Update the velocity limits.
+   * @brief Evaluate the control law for many targets at once. Inputs and
+   * outputs are structure-of-arrays, each of length count. On x86 CPUs
+   * with AVX2 or AVX-512 and MathBackend::EXACT the targets are processed
+   * several at a time, otherwise (including with the other math backends)
+   * this is equivalent to calling approach() for each target, so that a
+   * batch never mixes backends. The vectorized kernels agree with approach()
+   * to within 1e-9 for targets with r > 1e-6. Near theta + delta = +/-pi the
+   * law is discontinuous and the two paths can end up on different sides
+   * of the discontinuity.
+   * @param x The x coordinates of the goals, relative to robot base link.
+   * @param y The y coordinates of the goals, relative to robot base link.
+   * @param theta The angular orientations of the goals, relative to robot base link.
+   * @param vel_x The computed command velocities in the linear direction.
+   * @param vel_th The computed command velocities in the angular direction.
+   * @param count The number of goals.
+   * @param backward_motion Flag to indicate that the robot should move backward. False by default.
+   */
+  void approachBatch(const double* x, const double* y, const double* theta,
+                     double* vel_x, double* vel_th, size_t count,
+                     bool backward_motion=false) const;
+
+  /**
+   * @brief Same as above, but with the velocity limits given per call.
+   */
+  void approachBatch(const double* x, const double* y, const double* theta, const VelocityLimits& limits,
+                     double* vel_x, double* vel_th, size_t count,
+                     bool backward_motion=false) const;
+
+  /**
+   * @brief Same as above, but with a maximum linear velocity per target,
+   * which replaces limits.max_abs_velocity. This evaluates one target at
+   * several velocity caps in the lanes of a single vector.
+   * @param max_abs_velocity The maximum absolute velocities, of length count.
+   */
+  void approachBatch(const double* x, const double* y, const double* theta, const VelocityLimits& limits,
+                     const double* max_abs_velocity, double* vel_x, double* vel_th, size_t count,
+                     bool backward_motion=false) const;
+
+  /**
+   * @brief Get the gains of the control law.
+   */
+  const ControlLawParameters& getParameters() const
+  {
+    return params_;
+  }
+
+  /**
+   * @brief Get the default velocity limits.
+   */
+  const VelocityLimits& getVelocityLimits() const
+  {
+    return limits_;
+  }
+
+  /**
+   * @brief Update the default velocity limits. This modifies the controller,
+   * callers that share it between threads should pass limits to approach() instead.
    * @param min_abs_velocity The minimum absolute velocity in the linear direction.
    * @param max_abs_velocity The maximum absolute velocity in the linear direction.
    * @param max_abs_angular_velocity The maximum absolute velocity in the angular direction.
@@ -73,21 +379,14 @@ public:
                          const double max_abs_angular_velocity);
 
 private:
-  /*
-   * Parameters for approach controller
-   */
-  double k1_;  // ratio in change of theta to rate of change in r
-  double k2_;  // speed at which we converge to slow system
-  double min_abs_velocity_;
-  double max_abs_velocity_;
-  double max_decel_;
-  double max_abs_angular_velocity_;
-  double beta_;  // how fast velocity drops as k increases
-  double lambda_; // controls speed scaling based on curvature. A higher value of lambda results in more sharply peaked curves
-  double dist_;  // used to create the tracking line
+  const ControlLawParameters params_;
+  VelocityLimits limits_;
+  const MathBackend math_backend_;
+  const CurvatureTablePtr table_;
 };
 
 using GracefulControllerPtr = std::shared_ptr<GracefulController>;
+using GracefulControllerConstPtr = std::shared_ptr<const GracefulController>;
 
 }  // namespace graceful_controller
 
@@ -0,0 +1,364 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRACEFUL_CONTROLLER_GRACEFUL_ROLLOUT_HPP
+#define GRACEFUL_CONTROLLER_GRACEFUL_ROLLOUT_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include <graceful_controller/graceful_controller.hpp>
+
+namespace graceful_controller
+{
+
+/**
+ * @brief A pose in the plane.
+ */
+struct Pose2D
+{
+  double x;
+  double y;
+  double theta;
+};
+
+/**
+ * @brief A rigid transform in the plane. The sine and cosine of the rotation
+ * are computed once, so that applying the transform needs no trigonometry.
+ */
+struct Transform2D
+{
+  Transform2D() : x(0.0), y(0.0), yaw(0.0), cos_yaw(1.0), sin_yaw(0.0)
+  {
+  }
+
+  Transform2D(double x, double y, double yaw) : x(x), y(y), yaw(yaw), cos_yaw(std::cos(yaw)), sin_yaw(std::sin(yaw))
+  {
+  }
+
+  /**
+   * @brief Transform a pose. The heading is not normalized.
+   */
+  Pose2D apply(const Pose2D& pose) const
+  {
+    Pose2D result;
+    result.x = x + cos_yaw * pose.x - sin_yaw * pose.y;
+    result.y = y + sin_yaw * pose.x + cos_yaw * pose.y;
+    result.theta = yaw + pose.theta;
+    return result;
+  }
+
+  /**
+   * @brief The inverse transform.
+   */
+  Transform2D inverse() const
+  {
+    Transform2D result;
+    result.x = -cos_yaw * x - sin_yaw * y;
+    result.y = sin_yaw * x - cos_yaw * y;
+    result.yaw = -yaw;
+    result.cos_yaw = cos_yaw;
+    result.sin_yaw = -sin_yaw;
+    return result;
+  }
+
+  double x;
+  double y;
+  double yaw;
+  double cos_yaw;
+  double sin_yaw;
+};
+
+/**
+ * @brief Caller owned storage for the poses of a rollout. The rollout never
+ * grows the buffer, it stops with RolloutStatus::BUFFER_FULL instead.
+ */
+struct TrajectoryBuffer
+{
+  TrajectoryBuffer(Pose2D* poses, size_t capacity, double* footprint_scalings = nullptr)
+    : poses(poses), footprint_scalings(footprint_scalings), capacity(capacity), size(0)
+  {
+  }
+
+  Pose2D* poses;
+  // Optional, with the same capacity: footprint scaling of each pose, which
+  // RolloutParameters::lazy_collision_checking needs to check them afterwards
+  double* footprint_scalings;
+  size_t capacity;
+  size_t size;
+};
+
+/**
+ * @brief Collision check of a simulated pose.
+ * @param pose The pose, relative to the robot base link at the start of the rollout.
+ * @param footprint_scaling Ratio to expand the footprint by.
+ * @returns true if the pose is in collision.
+ */
+using CollisionChecker = std::function<bool(const Pose2D& pose, double footprint_scaling)>;
+
+/**
+ * @brief Integration of the commands during forward simulation.
+ */
+enum class RolloutIntegrator
+{
+  // Explicit Euler steps of one resolution each, the original simulation
+  EULER,
+  // Exact constant (v, w) arcs. The step length adapts to how quickly the
+  // command changes, between resolution and max_step_length. Long steps are
+  // collision checked at intermediate poses so that no point of the
+  // footprint moves more than resolution between checks.
+  ARC
+};
+
+/**
+ * @brief Parameters of the forward simulation.
+ */
+struct RolloutParameters
+{
+  // Distance travelled per step, usually the costmap resolution
+  double resolution = 0.05;
+
+  // Initial in place rotation towards the target
+  double initial_rotate_tolerance = 0.0;
+  double max_vel_theta = 1.0;
+  double min_in_place_vel_theta = 0.4;
+  double acc_lim_theta = 3.2;
+
+  // Footprint scaling with velocity
+  double max_vel_x = 0.5;
+  double scaling_vel_x = 0.5;
+  double scaling_factor = 0.0;
+
+  RolloutIntegrator integrator = RolloutIntegrator::EULER;
+  // ARC: longest step between evaluations of the control law
+  double max_step_length = 0.25;
+  // ARC: bound on the heading error of a step, caused by holding the command constant
+  double max_heading_error = 0.01;
+  // ARC: radius of the footprint (including scaling), bounds the sweep of rotating steps
+  double footprint_radius = 0.0;
+
+  // Carry the heading as a unit complex number (cos, sin), rotated by
+  // multiplication, rather than taking sines and cosines of it every step.
+  // Trajectories then differ from the default in the last few bits.
+  bool incremental_rotation = false;
+
+  // Integrate the whole trajectory first, and only collision check it once it
+  // reached the target: the last pose, then the middle one, then the middles of
+  // both halves and so on. Rollouts that collide somewhere along the way are
+  // usually rejected after a few checks, and those that do not converge are not
+  // checked at all. Only used when the trajectory has footprint_scalings.
+  bool lazy_collision_checking = false;
+};
+
+enum class RolloutStatus
+{
+  SUCCESS,      // Reached the target
+  COLLISION,    // The collision checker rejected a pose
+  NO_SOLUTION,  // The control law did not produce a command
+  BUFFER_FULL,  // Ran out of trajectory storage before reaching the target
+  ABANDONED     // simulateCaps() only: stopped because a faster cap reached the target,
+                // bisectCaps() callers: not simulated
+};
+
+struct RolloutResult
+{
+  RolloutStatus status;
+  // Command to execute, from the first step of the rollout
+  double vel_x;
+  double vel_th;
+  // The initial rotation was requested, but the start pose was already within tolerance
+  bool initially_aligned;
+  // Number of commands computed (control law or in place rotation)
+  size_t evaluations;
+};
+
+/**
+ * @brief Forward simulates the control law towards a target pose. This is
+ * the simulation behind GracefulControllerROS, without any dependency on ROS.
+ */
+class GracefulRollout
+{
+public:
+  /**
+   * @brief Constructor.
+   * @param controller The control law to simulate.
+   * @param params Parameters of the simulation.
+   */
+  GracefulRollout(const GracefulControllerConstPtr& controller, const RolloutParameters& params);
+
+  /**
+   * @brief Simulate towards a target. The simulation takes steps of length
+   * resolution (see RolloutIntegrator for the alternative, or 0.1s while
+   * rotating in place) until it is within resolution of the target. Every
+   * pose after the start is collision checked and stored in the trajectory,
+   * which is cleared first. No memory is allocated. With lazy collision
+   * checking, a colliding trajectory ends at the collision that was found,
+   * which need not be the first one, and a trajectory that does not reach
+   * the target is not checked.
+   * @param target The target pose, relative to robot base link.
+   * @param limits Velocity limits for the control law.
+   * @param initial_rotation Rotate in place towards the target before moving.
+   * @param is_colliding Collision check of each simulated pose.
+   * @param trajectory Returned poses of the simulation.
+   */
+  RolloutResult simulate(const Pose2D& target, const VelocityLimits& limits, bool initial_rotation,
+                         const CollisionChecker& is_colliding, TrajectoryBuffer& trajectory) const;
+
+  /**
+   * @brief Simulate towards a target once per velocity cap, and find the
+   * fastest cap that reaches it, like calling simulate() for each cap,
+   * fastest first, until one succeeds. With the EULER integrator the caps
+   * advance in lockstep instead: each step evaluates the control law for all
+   * remaining caps in one call to approachBatch(), and a cap drops out as soon
+   * as it collides, fails or is beaten by a faster cap that reached the
+   * target. Commands then agree with simulate() only to within the tolerance
+   * of approachBatch(), so a target right on a collision or convergence
+   * boundary may get a different cap than the sequential search. Either way
+   * the cap returned reached the target with every pose checked. With lazy
+   * collision checking, the caps are simulated one at a time. No memory is
+   * allocated.
+   * @param target The target pose, relative to robot base link.
+   * @param limits Velocity limits for the control law, except for max_abs_velocity.
+   * @param max_velocities Maximum linear velocity of each cap, fastest first.
+   * @param count The number of caps.
+   * @param initial_rotation Rotate in place towards the target before moving.
+   * @param is_colliding Collision check of each simulated pose.
+   * @param trajectories One buffer per cap, for the poses of its simulation.
+   * @param results One result per cap. Caps slower than the returned one
+   *        that were still running when it succeeded are RolloutStatus::ABANDONED.
+   * @returns The index of the fastest cap that reached the target, or count if none did.
+   */
+  size_t simulateCaps(const Pose2D& target, const VelocityLimits& limits, const double* max_velocities,
+                      size_t count, bool initial_rotation, const CollisionChecker& is_colliding,
+                      TrajectoryBuffer* trajectories, RolloutResult* results) const;
+
+  /**
+   * @brief Velocity to rotate in place by yaw, see GracefulControllerROS::rotateTowards().
+   */
+  double rotationVelocity(double yaw) const;
+
+  /**
+   * @brief Get the parameters of the simulation.
+   */
+  const RolloutParameters& getParameters() const
+  {
+    return params_;
+  }
+
+private:
+  RolloutResult simulateEuler(const Pose2D& target, const VelocityLimits& limits, bool initial_rotation,
+                              const CollisionChecker& is_colliding, TrajectoryBuffer& trajectory) const;
+
+  /**
+   * @brief Lockstep EULER simulation of up to MAX_LANES caps, see simulateCaps().
+   */
+  size_t simulateLanes(const Pose2D& target, const VelocityLimits& limits, const double* max_velocities,
+                       size_t count, bool initial_rotation, const CollisionChecker& is_colliding,
+                       TrajectoryBuffer* trajectories, RolloutResult* results) const;
+
+  RolloutResult simulateArc(const Pose2D& target, const VelocityLimits& limits, bool initial_rotation,
+                            const CollisionChecker& is_colliding, TrajectoryBuffer& trajectory) const;
+
+  /**
+   * @brief Collision check a trajectory coarse to fine, see lazy_collision_checking.
+   * @returns true if a pose collides, the trajectory then ends at that pose.
+   */
+  bool checkLazily(const CollisionChecker& is_colliding, TrajectoryBuffer& trajectory) const;
+
+  /**
+   * @brief Compute the command towards the target.
+   * @param error_x, error_y, error_angle Target relative to the current pose.
+   * @param error_yaw Normalized error_angle.
+   * @param rotating Whether the initial rotation is still in progress, cleared once within tolerance.
+   * @returns false if the control law has no solution.
+   */
+  bool computeCommand(double error_x, double error_y, double error_angle, double error_yaw,
+                      const VelocityLimits& limits, bool& rotating, double& vel_x, double& vel_th) const;
+
+  /**
+   * @brief Footprint scaling for a linear velocity.
+   */
+  double footprintScaling(double vel_x) const;
+
+  // Caps simulated together by simulateLanes(), more are handled in groups
+  static constexpr size_t MAX_LANES = 16;
+
+  GracefulControllerConstPtr controller_;
+  RolloutParameters params_;
+};
+
+/**
+ * @brief Find the fastest velocity cap that reaches a target by bisection,
+ * rather than trying the caps fastest first. This assumes that whenever a cap
+ * reaches the target, all slower caps do too, and then finds the same cap as
+ * the sequential search in about log2(count) + 2 calls to reaches(). The
+ * fastest cap is tried first, and the slowest one next if it fails, so both
+ * are always decided when no cap or the fastest one reaches the target.
+ * @param count The number of caps, fastest first.
+ * @param verify_steps Where feasibility is not monotone, a faster cap than the
+ *        one found might still reach the target. Up to this many of the caps just
+ *        faster than it that were skipped by the bisection are tried as well, and
+ *        the fastest of them that succeeds is returned instead.
+ * @param reaches Simulate cap i and return true if it reaches the target.
+ *        It is called at most once per cap.
+ * @returns The index of the fastest cap found to reach the target, or count if none did.
+ */
+size_t bisectCaps(size_t count, size_t verify_steps, const std::function<bool(size_t)>& reaches);
+
+/**
+ * @brief Find the first of count candidates that passes, assuming that once a
+ * candidate passes, so do all later ones (such as target poses of a path, from
+ * the far end towards the robot). Candidates 0, 1, 3, 7, ... are tried, with
+ * strides that double, until one passes, and then the last failure and that
+ * success are bisected. This takes about 2 log2(answer) + 1 calls to passes()
+ * instead of answer + 1 (a single one when the first candidate passes), and
+ * finds the same candidate as trying them in order. If no candidate tried
+ * passes, the skipped ones are tried in order after all.
+ * @param verify_steps Up to this many candidates after the one found, at
+ *        strides that double, are tried as well to check the assumption. Should
+ *        one of them fail, the skipped candidates before the one found are tried
+ *        in order, and the first of them that passes is returned instead.
+ * @param passes Evaluate candidate i, called at most once per candidate.
+ * @param outcomes Scratch storage for the outcome of each candidate, pass the
+ *        same vector every time so that the search does not allocate.
+ * @param monotone Set to false if a skipped candidate passed, so that the
+ *        candidate found differs from the one the assumption gives.
+ * @returns The index of the first candidate found to pass, or count if none did.
+ */
+size_t gallopSearch(size_t count, size_t verify_steps, const std::function<bool(size_t)>& passes,
+                    std::vector<char>& outcomes, bool& monotone);
+
+/**
+ * @brief Heading after a round trip through a quaternion, the same as
+ * tf2::getYaw() of the quaternion of rotation yaw about z. The rollout uses
+ * this wherever the message based simulation stored a heading as a quaternion,
+ * so that both produce the same trajectory.
+ */
+inline double quaternionYaw(double yaw)
+{
+  double z = std::sin(yaw / 2.0);
+  double w = std::cos(yaw / 2.0);
+  return std::atan2(2.0 * (0.0 + w * z), w * w - z * z);
+}
+
+}  // namespace graceful_controller
+
+#endif  // GRACEFUL_CONTROLLER_GRACEFUL_ROLLOUT_HPP
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRACEFUL_CONTROLLER_OCCUPANCY_INTEGRAL_HPP
+#define GRACEFUL_CONTROLLER_OCCUPANCY_INTEGRAL_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <graceful_controller/cost_grid.hpp>
+#include <graceful_controller/footprint_templates.hpp>
+
+namespace graceful_controller
+{
+
+/**
+ * @brief Summed area table of the occupied cells of a costmap, those at or
+ * above a threshold cost, so that the occupied cells of any rectangle are
+ * counted with four lookups.
+ *
+ * update() keeps a copy of which cells were occupied, and only recomputes
+ * the part of the table that depends on cells that changed since: entry
+ * (x, y) counts the cells up to x and y, so those at or after the first
+ * changed column and row. An update that only touches the far corner of the
+ * costmap is therefore cheap. A rolling window that moved changes most
+ * cells, and is recomputed almost entirely, as is a grid of a new size.
+ */
+class OccupancyIntegral
+{
+public:
+  /**
+   * @param threshold Lowest cost of an occupied cell.
+   */
+  explicit OccupancyIntegral(unsigned char threshold = LETHAL_COST);
+
+  /**
+   * @brief Bring the table up to date with the cells of a grid, which also
+   *        sets the grid that poses of isColliding() are in.
+   * @returns Number of entries of the table that were recomputed.
+   */
+  size_t update(const CostGrid& grid);
+
+  /**
+   * @brief Number of occupied cells in [x_begin, x_end) x [y_begin, y_end),
+   *        which must be within the grid.
+   */
+  uint32_t count(unsigned int x_begin, unsigned int y_begin, unsigned int x_end, unsigned int y_end) const
+  {
+    size_t stride = size_x_ + 1;
+    return table_[y_end * stride + x_end] - table_[y_begin * stride + x_end] -
+           table_[y_end * stride + x_begin] + table_[y_begin * stride + x_begin];
+  }
+
+  /**
+   * @brief Collision check the footprint at a pose, with the rectangles of
+   *        its templates: an occupied cell in any of them, or a rectangle off
+   *        the grid, is a collision.
+   * @param templates Templates of the footprint, at the resolution of the grid.
+   * @param x, y, yaw Pose of the robot in the frame of the grid.
+   * @param scaling Ratio to expand the footprint by, at most templates.getMaxScaling().
+   */
+  bool isColliding(const FootprintTemplates& templates, double x, double y, double yaw, double scaling) const;
+
+  unsigned char getThreshold() const
+  {
+    return threshold_;
+  }
+
+private:
+  unsigned char threshold_;
+
+  // The grid of the last update
+  unsigned int size_x_;
+  unsigned int size_y_;
+  double resolution_;
+  double origin_x_;
+  double origin_y_;
+
+  std::vector<unsigned char> occupied_;  // 1 for occupied cells, size_x_ * size_y_
+  std::vector<uint32_t> table_;  // (size_x_ + 1) * (size_y_ + 1), the first row and column are 0
+};
+
+}  // namespace graceful_controller
+
+#endif  // GRACEFUL_CONTROLLER_OCCUPANCY_INTEGRAL_HPP
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRACEFUL_CONTROLLER_ROLLOUT_CACHE_HPP
+#define GRACEFUL_CONTROLLER_ROLLOUT_CACHE_HPP
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <graceful_controller/graceful_rollout.hpp>
+
+namespace graceful_controller
+{
+
+/**
+ * @brief Rollouts kept across control cycles.
+ *
+ * Rollouts are keyed by their target, quantized to a resolution, their
+ * velocity cap and, with the initial rotation, the max_vel_theta of the
+ * rollout, which usually follows the odometry. On a hit, the stored trajectory and command are reused
+ * instead of evaluating the control law again, so a target that moved by less
+ * than the resolution gets the command of the stored one.
+ *
+ * The collision checks made by the stored rollout are recorded with it. They
+ * are replayed on a hit, unless the caller passes the same generation as when
+ * they last passed, which tells that neither the costmap nor the pose of the
+ * robot in it have changed since. Rollouts that collided are not stored.
+ *
+ * The cache does not know about the controller or the other rollout
+ * parameters, clear() it whenever they change.
+ */
+class RolloutCache
+{
+public:
+  /**
+   * @brief Allocate the storage of the cache, it does not grow afterwards.
+   * @param max_entries Number of rollouts kept, the least recently used one is evicted.
+   * @param max_poses Longest trajectory stored, longer rollouts are not cached.
+   * @param max_checks Most collision checks stored, rollouts that need more are not cached.
+   * @param resolution Quantization of the target, in meters and radians.
+   * @param velocity_resolution Quantization of the velocity cap.
+   */
+  RolloutCache(size_t max_entries, size_t max_poses, size_t max_checks,
+               double resolution, double velocity_resolution = 0.001);
+
+  /**
+   * @brief Same as GracefulRollout::simulate(), but reusing the stored rollout
+   *        of the same key if there is one.
+   * @param rollout The simulation to run on a miss.
+   * @param generation Stamp of the collision checker, see class description.
+   */
+  RolloutResult simulate(const GracefulRollout& rollout, const Pose2D& target, const VelocityLimits& limits,
+                         bool initial_rotation, const CollisionChecker& is_colliding, uint64_t generation,
+                         TrajectoryBuffer& trajectory);
+
+  /**
+   * @brief Forget all rollouts. The counters are kept.
+   */
+  void clear();
+
+  /**
+   * @brief Number of rollouts stored.
+   */
+  size_t size() const
+  {
+    return index_.size();
+  }
+
+  /**
+   * @brief Number of calls to simulate() that reused a stored rollout.
+   */
+  size_t getHits() const
+  {
+    return hits_;
+  }
+
+  /**
+   * @brief Number of calls to simulate() that had to run the rollout.
+   */
+  size_t getMisses() const
+  {
+    return misses_;
+  }
+
+private:
+  struct Key
+  {
+    int64_t x;
+    int64_t y;
+    int64_t theta;
+    int64_t max_velocity;
+    int64_t max_rotation_velocity;  // 0 without the initial rotation
+    bool initial_rotation;
+
+    bool operator==(const Key& other) const
+    {
+      return x == other.x && y == other.y && theta == other.theta && max_velocity == other.max_velocity &&
+             max_rotation_velocity == other.max_rotation_velocity && initial_rotation == other.initial_rotation;
+    }
+  };
+
+  struct KeyHash
+  {
+    size_t operator()(const Key& key) const;
+  };
+
+  // A collision check made by a rollout, and the length of the trajectory up to the checked pose
+  struct Check
+  {
+    Pose2D pose;
+    double footprint_scaling;
+    size_t trajectory_size;
+  };
+
+  struct Entry
+  {
+    Key key;
+    // Limits besides the velocity cap, which are part of the key
+    double min_abs_velocity;
+    double max_abs_angular_velocity;
+    RolloutResult result;
+    uint64_t generation;
+    size_t pose_count;
+    size_t check_count;
+    // Least recently used list, as indices into entries_
+    size_t prev;
+    size_t next;
+  };
+
+  Key makeKey(const Pose2D& target, double max_velocity, double max_rotation_velocity,
+              bool initial_rotation) const;
+
+  // Maintenance of the least recently used list
+  void unlink(size_t entry);
+  void pushFront(size_t entry);
+
+  size_t max_entries_;
+  size_t max_poses_;
+  size_t max_checks_;
+  double inverse_resolution_;
+  double inverse_velocity_resolution_;
+
+  std::vector<Entry> entries_;
+  std::vector<Pose2D> poses_;   // max_poses_ per entry
+  std::vector<Check> checks_;   // max_checks_ per entry
+  std::vector<Check> recorded_;  // checks of the rollout being simulated
+  std::unordered_map<Key, size_t, KeyHash> index_;
+  size_t head_;  // most recently used
+  size_t tail_;  // least recently used
+  size_t unused_;  // entries_ from here on have never been used
+
+  size_t hits_;
+  size_t misses_;
+};
+
+}  // namespace graceful_controller
+
+#endif  // GRACEFUL_CONTROLLER_ROLLOUT_CACHE_HPP
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRACEFUL_CONTROLLER_THREAD_POOL_HPP
+#define GRACEFUL_CONTROLLER_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace graceful_controller
+{
+
+/**
+ * @brief Fixed set of worker threads that run batches of indexed tasks.
+ *
+ * The indices of a batch are dealt round robin to one queue per worker, so
+ * that the lowest indices start first. A worker that empties its own queue
+ * steals the lowest index left in the others, so the batch still runs in
+ * roughly increasing order when the tasks take very different times.
+ */
+class ThreadPool
+{
+public:
+  /**
+   * @brief A task of a batch.
+   * @param index Index of the task in the batch.
+   * @param worker Index of the worker running it, in [0, size()).
+   */
+  using Task = std::function<void(size_t index, size_t worker)>;
+
+  /**
+   * @brief Start the workers.
+   * @param workers Number of threads.
+   * @param cpus If not empty, worker i is pinned to cpus[i % cpus.size()]. This is
+   *        best effort, and only supported on Linux.
+   */
+  explicit ThreadPool(size_t workers, const std::vector<int>& cpus = std::vector<int>());
+
+  /**
+   * @brief Stop the workers, waiting for the current batch to finish.
+   */
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /**
+   * @brief Number of workers.
+   */
+  size_t size() const
+  {
+    return threads_.size();
+  }
+
+  /**
+   * @brief Run task(i, worker) for every i in [0, count) and wait for all of them.
+   *        Only one batch runs at a time, the calling thread does not run tasks.
+   */
+  void run(size_t count, const Task& task);
+
+private:
+  // Indices of one worker, taken from the front by the owner and by thieves
+  struct Queue
+  {
+    std::mutex mutex;
+    std::vector<size_t> indices;
+    size_t head = 0;
+  };
+
+  void work(size_t worker);
+
+  // Take the next index for a worker, from its own queue or stolen from another
+  bool next(size_t worker, size_t& index);
+
+  std::vector<std::thread> threads_;
+  std::vector<std::unique_ptr<Queue>> queues_;
+
+  // Batch coordination
+  std::mutex run_mutex_;  // one batch at a time
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  const Task* task_;
+  uint64_t batch_;
+  size_t running_;
+  bool stop_;
+};
+
+/**
+ * @brief Evaluate candidates on a pool, for the first one that passes.
+ * @param candidate Index of the candidate.
+ * @param worker Index of the worker running it.
+ * @param first The best candidate found so far. Once it is lower than
+ *        candidate, the result is not used and the evaluation can give up.
+ * @returns true if the candidate passes.
+ */
+using CandidateEvaluator =
+    std::function<bool(size_t candidate, size_t worker, const std::atomic<size_t>& first)>;
+
+/**
+ * @brief Find the first of count candidates that passes, in parallel.
+ *
+ * The answer is the same as evaluating the candidates in order and stopping
+ * at the first that passes: every candidate before it is fully evaluated.
+ * Candidates after the best one found so far are not started.
+ *
+ * @returns Index of the first candidate that passed, or count if none did.
+ */
+size_t findFirstSuccess(ThreadPool& pool, size_t count, const CandidateEvaluator& evaluate);
+
+}  // namespace graceful_controller
+
+#endif  // GRACEFUL_CONTROLLER_THREAD_POOL_HPP
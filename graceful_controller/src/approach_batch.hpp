@@ -0,0 +1,71 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRACEFUL_CONTROLLER_APPROACH_BATCH_HPP
+#define GRACEFUL_CONTROLLER_APPROACH_BATCH_HPP
+
+#include <cstddef>
+
+namespace graceful_controller
+{
+namespace detail
+{
+
+/**
+ * @brief Snapshot of the control law parameters handed to the SIMD kernels.
+ */
+struct BatchParameters
+{
+  double k1;
+  double k2;
+  double min_abs_velocity;
+  double max_abs_velocity;
+  // Optional maximum velocity per lane, replaces max_abs_velocity when not null
+  const double* max_abs_velocities;
+  double max_decel;
+  double max_abs_angular_velocity;
+  double beta;
+  double lambda;
+};
+
+/*
+ * Each kernel processes as many full vectors as fit in count and returns
+ * the number of lanes it computed. The caller finishes the remainder.
+ * Kernels are only compiled when the compiler supports the instruction
+ * set and must only be called when the CPU supports it.
+ */
+
+#ifdef GRACEFUL_CONTROLLER_HAVE_AVX2
+size_t approachBatchAVX2(const BatchParameters& params,
+                         const double* x, const double* y, const double* theta,
+                         double* vel_x, double* vel_th, size_t count,
+                         bool backward_motion);
+#endif
+
+#ifdef GRACEFUL_CONTROLLER_HAVE_AVX512
+size_t approachBatchAVX512(const BatchParameters& params,
+                           const double* x, const double* y, const double* theta,
+                           double* vel_x, double* vel_th, size_t count,
+                           bool backward_motion);
+#endif
+
+}  // namespace detail
+}  // namespace graceful_controller
+
+#endif  // GRACEFUL_CONTROLLER_APPROACH_BATCH_HPP
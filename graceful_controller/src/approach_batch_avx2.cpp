@@ -0,0 +1,110 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// This file is compiled with -mavx2 -mfma
+
+#include <immintrin.h>
+
+#include "approach_batch_kernel.hpp"
+
+namespace graceful_controller
+{
+namespace detail
+{
+namespace
+{
+
+/**
+ * @brief Vector operations for four double lanes in an AVX2 register.
+ */
+struct Avx2Ops
+{
+  typedef __m256d V;
+  typedef __m256d M;
+  static const size_t width = 4;
+
+  static V load(const double* p) { return _mm256_loadu_pd(p); }
+  static void store(double* p, V a) { _mm256_storeu_pd(p, a); }
+  static V set(double a) { return _mm256_set1_pd(a); }
+
+  static V add(V a, V b) { return _mm256_add_pd(a, b); }
+  static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+  static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+  static V div(V a, V b) { return _mm256_div_pd(a, b); }
+  static V fma(V a, V b, V c) { return _mm256_fmadd_pd(a, b, c); }
+  static V sqrt(V a) { return _mm256_sqrt_pd(a); }
+  static V round(V a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+  static V trunc(V a) { return _mm256_round_pd(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+
+  static V abs(V a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+  static V neg(V a) { return _mm256_xor_pd(_mm256_set1_pd(-0.0), a); }
+  static V copysign(V magnitude, V sign)
+  {
+    const V sign_bit = _mm256_set1_pd(-0.0);
+    return _mm256_or_pd(_mm256_andnot_pd(sign_bit, magnitude), _mm256_and_pd(sign_bit, sign));
+  }
+
+  // Arguments are swapped so that NaN handling matches std::min and std::max
+  static V min(V a, V b) { return _mm256_min_pd(b, a); }
+  static V max(V a, V b) { return _mm256_max_pd(b, a); }
+
+  static M lt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+  static M le(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+  static M gt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+  static M eq(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+  static M neq(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_NEQ_UQ); }
+  static M land(M a, M b) { return _mm256_and_pd(a, b); }
+  static V select(M m, V a, V b) { return _mm256_blendv_pd(b, a, m); }
+
+  // Unbiased exponent of a positive normal number
+  static V exponent(V a)
+  {
+    const V magic = _mm256_set1_pd(4503599627370496.0);  // 2^52
+    const __m256i biased = _mm256_srli_epi64(_mm256_castpd_si256(a), 52);
+    const V e = _mm256_castsi256_pd(_mm256_or_si256(biased, _mm256_castpd_si256(magic)));
+    return _mm256_sub_pd(e, _mm256_set1_pd(4503599627370496.0 + 1023.0));
+  }
+
+  // Significand of a positive normal number, in [1, 2)
+  static V mantissa(V a)
+  {
+    const __m256i bits = _mm256_and_si256(_mm256_castpd_si256(a), _mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL));
+    return _mm256_castsi256_pd(_mm256_or_si256(bits, _mm256_set1_epi64x(0x3FF0000000000000LL)));
+  }
+
+  // 2^n for integer valued n in [-1022, 1023]
+  static V pow2(V n)
+  {
+    const V biased = _mm256_add_pd(n, _mm256_set1_pd(4503599627370496.0 + 1023.0));
+    return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(biased), 52));
+  }
+};
+
+}  // namespace
+
+size_t approachBatchAVX2(const BatchParameters& params,
+                         const double* x, const double* y, const double* theta,
+                         double* vel_x, double* vel_th, size_t count,
+                         bool backward_motion)
+{
+  return approachLanes<Avx2Ops>(params, x, y, theta, vel_x, vel_th, count, backward_motion);
+}
+
+}  // namespace detail
+}  // namespace graceful_controller
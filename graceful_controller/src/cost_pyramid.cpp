@@ -0,0 +1,203 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include <graceful_controller/cost_pyramid.hpp>
+
+namespace graceful_controller
+{
+
+CostPyramid::CostPyramid(size_t levels)
+  : levels_(std::max<size_t>(levels, 1)), resolution_(0.0), origin_x_(0.0), origin_y_(0.0)
+{
+  for (Level& level : levels_)
+  {
+    level.size_x = 0;
+    level.size_y = 0;
+  }
+}
+
+size_t CostPyramid::update(const CostGrid& grid)
+{
+  Level& cells = levels_[0];
+
+  // Box of the cells that changed
+  unsigned int x_begin = grid.size_x;
+  unsigned int y_begin = grid.size_y;
+  unsigned int x_end = 0;
+  unsigned int y_end = 0;
+  if (grid.size_x != cells.size_x || grid.size_y != cells.size_y || cells.costs.empty())
+  {
+    // Every cell is new
+    unsigned int size_x = grid.size_x;
+    unsigned int size_y = grid.size_y;
+    for (Level& level : levels_)
+    {
+      level.size_x = size_x;
+      level.size_y = size_y;
+      level.costs.assign(static_cast<size_t>(size_x) * size_y, 0);
+      size_x = (size_x + 1) / 2;
+      size_y = (size_y + 1) / 2;
+    }
+    std::copy(grid.costs, grid.costs + cells.costs.size(), cells.costs.begin());
+    x_begin = 0;
+    y_begin = 0;
+    x_end = grid.size_x;
+    y_end = grid.size_y;
+  }
+  else
+  {
+    for (unsigned int y = 0; y < cells.size_y; ++y)
+    {
+      const unsigned char* row = grid.costs + static_cast<size_t>(y) * cells.size_x;
+      unsigned char* copy = &cells.costs[static_cast<size_t>(y) * cells.size_x];
+      if (std::memcmp(row, copy, cells.size_x) == 0)
+      {
+        continue;
+      }
+      unsigned int first = 0;
+      while (row[first] == copy[first])
+      {
+        ++first;
+      }
+      unsigned int last = cells.size_x;
+      while (row[last - 1] == copy[last - 1])
+      {
+        --last;
+      }
+      std::copy(row + first, row + last, copy + first);
+      x_begin = std::min(x_begin, first);
+      x_end = std::max(x_end, last);
+      y_begin = std::min(y_begin, y);
+      y_end = y + 1;
+    }
+  }
+  resolution_ = grid.resolution;
+  origin_x_ = grid.origin_x;
+  origin_y_ = grid.origin_y;
+
+  // Recompute the cells above the box, level by level
+  size_t recomputed = 0;
+  for (size_t l = 1; l < levels_.size() && x_begin < x_end && y_begin < y_end; ++l)
+  {
+    const Level& fine = levels_[l - 1];
+    Level& coarse = levels_[l];
+    x_begin /= 2;
+    y_begin /= 2;
+    x_end = (x_end + 1) / 2;
+    y_end = (y_end + 1) / 2;
+    for (unsigned int y = y_begin; y < y_end; ++y)
+    {
+      const unsigned char* row0 = &fine.costs[static_cast<size_t>(2 * y) * fine.size_x];
+      // The last row of an odd level has no second row below
+      const unsigned char* row1 = (2 * y + 1 < fine.size_y) ? row0 + fine.size_x : row0;
+      unsigned char* row = &coarse.costs[static_cast<size_t>(y) * coarse.size_x];
+      for (unsigned int x = x_begin; x < x_end; ++x)
+      {
+        unsigned int x1 = std::min(2 * x + 1, fine.size_x - 1);
+        row[x] = std::max(std::max(row0[2 * x], row0[x1]), std::max(row1[2 * x], row1[x1]));
+      }
+    }
+    recomputed += static_cast<size_t>(x_end - x_begin) * (y_end - y_begin);
+  }
+  return recomputed;
+}
+
+bool CostPyramid::isBelow(unsigned int x_begin, unsigned int y_begin, unsigned int x_end, unsigned int y_end,
+                          unsigned char threshold) const
+{
+  if (x_begin >= x_end || y_begin >= y_end)
+  {
+    return true;
+  }
+
+  // Start from the coarsest level where the box spans at most 2 x 2 cells
+  size_t level = levels_.size() - 1;
+  while (level > 0 && (((x_end - 1) >> level) - (x_begin >> level) > 1 ||
+                       ((y_end - 1) >> level) - (y_begin >> level) > 1))
+  {
+    --level;
+  }
+  for (unsigned int y = y_begin >> level; y <= (y_end - 1) >> level; ++y)
+  {
+    for (unsigned int x = x_begin >> level; x <= (x_end - 1) >> level; ++x)
+    {
+      if (!isBelow(level, x, y, x_begin, y_begin, x_end, y_end, threshold))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool CostPyramid::isFree(double x, double y, double radius, unsigned char threshold) const
+{
+  const Level& cells = levels_[0];
+  if (cells.costs.empty() || x - radius < origin_x_ || y - radius < origin_y_)
+  {
+    return false;
+  }
+  unsigned int x_begin = static_cast<unsigned int>((x - radius - origin_x_) / resolution_);
+  unsigned int y_begin = static_cast<unsigned int>((y - radius - origin_y_) / resolution_);
+  double x_last = (x + radius - origin_x_) / resolution_;
+  double y_last = (y + radius - origin_y_) / resolution_;
+  if (x_last >= cells.size_x || y_last >= cells.size_y)
+  {
+    // Partly off the grid
+    return false;
+  }
+  return isBelow(x_begin, y_begin, static_cast<unsigned int>(x_last) + 1, static_cast<unsigned int>(y_last) + 1,
+                 threshold);
+}
+
+bool CostPyramid::isBelow(size_t level, unsigned int x, unsigned int y, unsigned int x_begin, unsigned int y_begin,
+                          unsigned int x_end, unsigned int y_end, unsigned char threshold) const
+{
+  if (getCost(level, x, y) < threshold)
+  {
+    return true;
+  }
+  if (level == 0)
+  {
+    return false;
+  }
+
+  // Refine into the cells of the level below that overlap the box
+  size_t below = level - 1;
+  unsigned int first_x = std::max(2 * x, x_begin >> below);
+  unsigned int last_x = std::min(2 * x + 1, (x_end - 1) >> below);
+  unsigned int first_y = std::max(2 * y, y_begin >> below);
+  unsigned int last_y = std::min(2 * y + 1, (y_end - 1) >> below);
+  for (unsigned int cy = first_y; cy <= last_y; ++cy)
+  {
+    for (unsigned int cx = first_x; cx <= last_x; ++cx)
+    {
+      if (!isBelow(below, cx, cy, x_begin, y_begin, x_end, y_end, threshold))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace graceful_controller
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <graceful_controller/curvature_table.hpp>
+
+namespace graceful_controller
+{
+
+constexpr double CurvatureTable::DEFAULT_RESOLUTION;
+constexpr double CurvatureTable::MIN_RESOLUTION;
+
+CurvatureTable::CurvatureTable(const ControlLawParameters& params, double resolution)
+  : params_(params)
+{
+  // Whole number of cells, so that both ends of [-pi, pi] are sampled
+  resolution = std::max(resolution, MIN_RESOLUTION);
+  int cells = std::max(2, static_cast<int>(std::ceil(2.0 * M_PI / resolution)));
+  resolution_ = 2.0 * M_PI / cells;
+  inverse_resolution_ = 1.0 / resolution_;
+  max_index_ = cells;
+  size_ = cells + 1;
+
+  table_.resize(size_ * size_);
+  for (int j = 0; j < size_; ++j)
+  {
+    double theta2 = -M_PI + j * resolution_;
+    for (int i = 0; i < size_; ++i)
+    {
+      double delta = -M_PI + i * resolution_;
+      table_[j * size_ + i] = curvatureNumerator(params_, delta, theta2);
+    }
+  }
+
+  // Bilinear interpolation error peaks near the center of a cell
+  max_error_ = 0.0;
+  for (int j = 0; j < cells; ++j)
+  {
+    double theta2 = -M_PI + (j + 0.5) * resolution_;
+    for (int i = 0; i < cells; ++i)
+    {
+      double delta = -M_PI + (i + 0.5) * resolution_;
+      double error = std::fabs(lookup(delta, theta2) - curvatureNumerator(params_, delta, theta2));
+      max_error_ = std::max(max_error_, error);
+    }
+  }
+}
+
+double CurvatureTable::curvatureNumerator(const ControlLawParameters& params, double delta, double theta2)
+{
+  // Same as approachKernel(), without the 1/r
+  double k1 = params.k1;
+  double a = std::atan(-k1 * theta2);
+  return -(params.k2 * (delta - a) + (1 + (k1/(1+((k1*theta2)*(k1*theta2)))))*std::sin(delta));
+}
+
+}  // namespace graceful_controller
@@ -0,0 +1,310 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <graceful_controller/footprint_templates.hpp>
+
+namespace graceful_controller
+{
+
+// Spacing of the points sampled along each edge of the footprint, in cells
+static constexpr double EDGE_STEP = 0.25;
+
+// Largest distance a vertex moves between sampled headings (or scalings) of a template, in cells
+static constexpr double SAMPLE_STEP = 0.5;
+
+FootprintTemplates::FootprintTemplates(const std::vector<Point2D>& footprint, double resolution, size_t yaw_bins,
+                                       double max_scaling, double scaling_step, bool filled,
+                                       size_t max_rectangles)
+  : footprint_(footprint), resolution_(resolution), yaw_bins_(std::max<size_t>(yaw_bins, 1)),
+    scaling_step_(scaling_step), filled_(filled), max_rectangles_(std::max<size_t>(max_rectangles, 1)), levels_(1)
+{
+  if (scaling_step_ > 0.0 && max_scaling > 1.0)
+  {
+    levels_ = static_cast<size_t>(std::ceil((max_scaling - 1.0) / scaling_step_ - 1e-9)) + 1;
+  }
+
+  std::vector<unsigned char> cells;
+  offsets_.reserve(levels_ * yaw_bins_ + 1);
+  rectangle_offsets_.reserve(levels_ * yaw_bins_ + 1);
+  for (size_t level = 0; level < levels_; ++level)
+  {
+    for (size_t bin = 0; bin < yaw_bins_; ++bin)
+    {
+      offsets_.push_back(spans_.size());
+      build(level, bin, cells);
+      rectangle_offsets_.push_back(rectangles_.size());
+      buildRectangles();
+    }
+  }
+  offsets_.push_back(spans_.size());
+  rectangle_offsets_.push_back(rectangles_.size());
+}
+
+bool FootprintTemplates::isColliding(const CostGrid& grid, double x, double y, double yaw, double scaling,
+                                     unsigned char threshold) const
+{
+  unsigned int mx, my;
+  if (!grid.worldToMap(x, y, mx, my))
+  {
+    return true;
+  }
+
+  size_t count;
+  const FootprintSpan* spans = getSpans(yaw, scaling, count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    long row = static_cast<long>(my) + spans[i].dy;
+    long begin = static_cast<long>(mx) + spans[i].x_begin;
+    long end = static_cast<long>(mx) + spans[i].x_end;
+    if (row < 0 || row >= grid.size_y || begin < 0 || end > grid.size_x)
+    {
+      // Off the grid
+      return true;
+    }
+    if (getMaxCost(grid.costs + row * grid.size_x + begin, end - begin) >= threshold)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+const FootprintSpan* FootprintTemplates::getSpans(double yaw, double scaling, size_t& count) const
+{
+  size_t i = index(yaw, scaling);
+  count = offsets_[i + 1] - offsets_[i];
+  return spans_.data() + offsets_[i];
+}
+
+const FootprintRectangle* FootprintTemplates::getRectangles(double yaw, double scaling, size_t& count) const
+{
+  size_t i = index(yaw, scaling);
+  count = rectangle_offsets_[i + 1] - rectangle_offsets_[i];
+  return rectangles_.data() + rectangle_offsets_[i];
+}
+
+size_t FootprintTemplates::index(double yaw, double scaling) const
+{
+  // Round the scaling up to a level
+  size_t level = 0;
+  if (scaling > 1.0 && scaling_step_ > 0.0)
+  {
+    level = std::min(static_cast<size_t>(std::ceil((scaling - 1.0) / scaling_step_ - 1e-9)), levels_ - 1);
+  }
+
+  // Bins split [-pi, pi) evenly
+  double turns = (yaw + M_PI) / (2.0 * M_PI);
+  turns -= std::floor(turns);
+  size_t bin = std::min(static_cast<size_t>(turns * yaw_bins_), yaw_bins_ - 1);
+
+  return level * yaw_bins_ + bin;
+}
+
+void FootprintTemplates::build(size_t level, size_t bin, std::vector<unsigned char>& cells)
+{
+  // Level 0 is the footprint as is, level i covers the scalings in (1 + (i - 1) * step, 1 + i * step]
+  double max_scale = (1.0 + level * scaling_step_) / resolution_;
+  double min_scale = (level == 0) ? max_scale : max_scale - scaling_step_ / resolution_;
+  double extent = 0.0;
+  for (const Point2D& point : footprint_)
+  {
+    extent = std::max(extent, std::hypot(point.x, point.y));
+  }
+  double radius = extent * max_scale;
+
+  // Sample headings across the bin and scalings across the level, finely
+  // enough that no vertex is more than yaw_error (scaling_error) from where
+  // it is at the closest sample
+  double bin_width = 2.0 * M_PI / yaw_bins_;
+  size_t yaw_samples = std::max<size_t>(1, static_cast<size_t>(std::ceil(radius * bin_width / SAMPLE_STEP)));
+  double yaw_error = 0.5 * radius * bin_width / yaw_samples;
+  double scale_range = extent * (max_scale - min_scale);
+  size_t scale_samples = std::max<size_t>(1, static_cast<size_t>(std::ceil(scale_range / SAMPLE_STEP)));
+  double scaling_error = 0.5 * scale_range / scale_samples;
+
+  // A point p of the boundary (in cells, relative to the robot) lies in cell
+  // floor(p + f), where f in [0, 1) is the position of the robot in its cell.
+  // Points between the sampled ones, and at headings and scalings between the
+  // sampled ones, are at most margin away from a sampled point p.
+  double margin = yaw_error + scaling_error + 0.5 * EDGE_STEP;
+  int half = static_cast<int>(std::ceil(radius + margin)) + 2;
+  int side = 2 * half + 1;
+  cells.assign(side * side, 0);
+
+  for (size_t yaw_sample = 0; yaw_sample < yaw_samples; ++yaw_sample)
+  {
+    double yaw = -M_PI + bin_width * (bin + (yaw_sample + 0.5) / yaw_samples);
+    for (size_t scale_sample = 0; scale_sample < scale_samples; ++scale_sample)
+    {
+      double scale = min_scale + (max_scale - min_scale) * (scale_sample + 0.5) / scale_samples;
+      double cos_yaw = std::cos(yaw) * scale;
+      double sin_yaw = std::sin(yaw) * scale;
+      for (size_t i = 0; i < footprint_.size(); ++i)
+      {
+        const Point2D& a = footprint_[i];
+        const Point2D& b = footprint_[(i + 1) % footprint_.size()];
+        double ax = a.x * cos_yaw - a.y * sin_yaw;
+        double ay = a.x * sin_yaw + a.y * cos_yaw;
+        double bx = b.x * cos_yaw - b.y * sin_yaw;
+        double by = b.x * sin_yaw + b.y * cos_yaw;
+        size_t steps = std::max<size_t>(1, static_cast<size_t>(std::ceil(std::hypot(bx - ax, by - ay) / EDGE_STEP)));
+        for (size_t step = 0; step <= steps; ++step)
+        {
+          double t = static_cast<double>(step) / steps;
+          double px = ax + t * (bx - ax);
+          double py = ay + t * (by - ay);
+          int x0 = static_cast<int>(std::floor(px - margin));
+          int x1 = static_cast<int>(std::floor(px + margin)) + 1;
+          int y0 = static_cast<int>(std::floor(py - margin));
+          int y1 = static_cast<int>(std::floor(py + margin)) + 1;
+          for (int cy = y0; cy <= y1; ++cy)
+          {
+            for (int cx = x0; cx <= x1; ++cx)
+            {
+              cells[(cy + half) * side + (cx + half)] = 1;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Runs of marked cells, row by row
+  for (int cy = 0; cy < side; ++cy)
+  {
+    const unsigned char* row = &cells[cy * side];
+    if (filled_)
+    {
+      // Any cell inside the footprint lies between boundary cells of its row
+      const unsigned char* first = std::find(row, row + side, 1);
+      if (first != row + side)
+      {
+        int begin = static_cast<int>(first - row);
+        int end = side;
+        while (!row[end - 1])
+        {
+          --end;
+        }
+        spans_.push_back({ cy - half, begin - half, end - half });
+      }
+      continue;
+    }
+    int cx = 0;
+    while (cx < side)
+    {
+      if (!row[cx])
+      {
+        ++cx;
+        continue;
+      }
+      int begin = cx;
+      while (cx < side && row[cx])
+      {
+        ++cx;
+      }
+      spans_.push_back({ cy - half, begin - half, cx - half });
+    }
+  }
+}
+
+void FootprintTemplates::buildRectangles()
+{
+  // Extent of each row of the template, which the spans hold in order
+  struct Row
+  {
+    int dy;
+    int begin;
+    int end;
+  };
+  std::vector<Row> rows;
+  for (size_t i = offsets_.back(); i < spans_.size(); ++i)
+  {
+    const FootprintSpan& span = spans_[i];
+    if (rows.empty() || rows.back().dy != span.dy)
+    {
+      rows.push_back({ span.dy, span.x_begin, span.x_end });
+    }
+    rows.back().begin = std::min(rows.back().begin, span.x_begin);
+    rows.back().end = std::max(rows.back().end, span.x_end);
+  }
+  if (rows.empty())
+  {
+    rectangles_.push_back({ 0, 1, 0, 1 });
+    return;
+  }
+
+  // Split the rows into consecutive groups, each covered by its bounding
+  // rectangle, so that the rectangles hold as few extra cells as possible.
+  // waste[g][j] is the least number of extra cells over rows [0, j) in g groups.
+  size_t n = rows.size();
+  size_t groups = std::min(max_rectangles_, n);
+  const long NONE = std::numeric_limits<long>::max();
+  std::vector<std::vector<long>> waste(groups + 1, std::vector<long>(n + 1, NONE));
+  std::vector<std::vector<size_t>> split(groups + 1, std::vector<size_t>(n + 1, 0));
+  waste[0][0] = 0;
+  for (size_t g = 1; g <= groups; ++g)
+  {
+    for (size_t first = g - 1; first < n; ++first)
+    {
+      if (waste[g - 1][first] == NONE)
+      {
+        continue;
+      }
+      // Grow a group from row first, keeping its extra cells
+      int begin = rows[first].begin;
+      int end = rows[first].end;
+      long cells = 0;
+      for (size_t last = first; last < n; ++last)
+      {
+        begin = std::min(begin, rows[last].begin);
+        end = std::max(end, rows[last].end);
+        cells += rows[last].end - rows[last].begin;
+        long extra = waste[g - 1][first] + static_cast<long>(last - first + 1) * (end - begin) - cells;
+        if (extra < waste[g][last + 1])
+        {
+          waste[g][last + 1] = extra;
+          split[g][last + 1] = first;
+        }
+      }
+    }
+  }
+
+  // Fewer groups are never better than the most allowed, walk back from there
+  size_t offset = rectangles_.size();
+  size_t end_row = n;
+  for (size_t g = groups; g > 0; --g)
+  {
+    size_t first = split[g][end_row];
+    FootprintRectangle rectangle = { rows[first].begin, rows[first].end, rows[first].dy, rows[end_row - 1].dy + 1 };
+    for (size_t row = first; row < end_row; ++row)
+    {
+      rectangle.x_begin = std::min(rectangle.x_begin, rows[row].begin);
+      rectangle.x_end = std::max(rectangle.x_end, rows[row].end);
+    }
+    rectangles_.push_back(rectangle);
+    end_row = first;
+  }
+  std::reverse(rectangles_.begin() + offset, rectangles_.end());
+}
+
+}  // namespace graceful_controller
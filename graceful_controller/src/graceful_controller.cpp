@@ -17,77 +17,154 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <graceful_controller/curvature_table.hpp>
 #include <graceful_controller/graceful_controller.hpp>
 
-#include <angles/angles.h>
-
-#include <algorithm>
-#include <list>
-#include <vector>
-#include <cmath>
+#include "approach_batch.hpp"
 
 namespace graceful_controller
 {
 
+/**
+ * @brief Build a table with the default resolution, if the backend needs one.
+ */
+static CurvatureTablePtr makeTable(const ControlLawParameters& params, MathBackend math_backend)
+{
+  if (math_backend == MathBackend::LOOKUP_TABLE)
+  {
+    return std::make_shared<const CurvatureTable>(params, CurvatureTable::DEFAULT_RESOLUTION);
+  }
+  return CurvatureTablePtr();
+}
+
 GracefulController::GracefulController(double k1, double k2,
                                        double min_abs_velocity, double max_abs_velocity,
                                        double max_decel,
                                        double max_abs_angular_velocity,
-                                       double beta, double lambda)
+                                       double beta, double lambda,
+                                       MathBackend math_backend)
+  : params_(k1, k2, max_decel, beta, lambda),
+    math_backend_(math_backend),
+    table_(makeTable(params_, math_backend))
+{
+  limits_.min_abs_velocity = min_abs_velocity;
+  limits_.max_abs_velocity = max_abs_velocity;
+  limits_.max_abs_angular_velocity = max_abs_angular_velocity;
+}
+
+GracefulController::GracefulController(const ControlLawParameters& params,
+                                       const VelocityLimits& limits,
+                                       MathBackend math_backend)
+  : params_(params),
+    limits_(limits),
+    math_backend_(math_backend),
+    table_(makeTable(params_, math_backend))
+{
+}
+
+GracefulController::GracefulController(const CurvatureTablePtr& table,
+                                       const VelocityLimits& limits)
+  : params_(table->getParameters()),
+    limits_(limits),
+    math_backend_(MathBackend::LOOKUP_TABLE),
+    table_(table)
 {
-  k1_ = k1;
-  k2_ = k2;
-  min_abs_velocity_ = min_abs_velocity;
-  max_abs_velocity_ = max_abs_velocity;
-  max_decel_ = max_decel;
-  max_abs_angular_velocity_ = max_abs_angular_velocity;
-  beta_ = beta;
-  lambda_ = lambda;
 }
 
 // x, y, theta are relative to base location and orientation
 bool GracefulController::approach(const double x, const double y, const double theta,
-                                  double& vel_x, double& vel_th, bool backward_motion)
+                                  double& vel_x, double& vel_th, bool backward_motion) const
+{
+  return approach(x, y, theta, limits_, vel_x, vel_th, backward_motion);
+}
+
+bool GracefulController::approach(const double x, const double y, const double theta,
+                                  const VelocityLimits& limits,
+                                  double& vel_x, double& vel_th, bool backward_motion) const
 {
-  // Distance to goal
-  double r = std::sqrt(x * x + y * y);
-
-  // Orientation base frame relative to r_
-  double delta = (backward_motion) ? std::atan2(-y, -x) : std::atan2(-y, x);
-
-  // Determine orientation of goal frame relative to r_
-  double theta2 = angles::normalize_angle(theta + delta);
-
-  // Compute the virtual control
-  double a = std::atan(-k1_ * theta2);
-  // Compute curvature (k)
-  double k = -1.0/r * (k2_ * (delta - a) + (1 + (k1_/(1+((k1_*theta2)*(k1_*theta2)))))*sin(delta));
-
-  // Compute max_velocity based on curvature
-  double v = max_abs_velocity_ / (1 + beta_ * std::pow(fabs(k), lambda_));
-  // Limit velocity based on approaching target
-  double approach_limit = std::sqrt(2 * max_decel_ * r);
-  v = std::min(v, approach_limit);
-  v = std::min(std::max(v, min_abs_velocity_), max_abs_velocity_);
-  if (backward_motion)
+  if (math_backend_ == MathBackend::LOOKUP_TABLE)
   {
-    v *= -1; // reverse linear velocity direction for backward motion
+    double r = std::sqrt(x * x + y * y);
+    double delta = (backward_motion) ? FastMath::atan2(-y, -x) : FastMath::atan2(-y, x);
+    double theta2 = angles::normalize_angle(theta + delta);
+    double k = table_->lookup(delta, theta2) / r;
+    return approachCurvature<FastMath>(params_, limits, r, k, vel_x, vel_th, backward_motion);
   }
+  if (math_backend_ == MathBackend::APPROXIMATE)
+  {
+    return approachKernel<FastMath>(params_, limits, x, y, theta, vel_x, vel_th, backward_motion);
+  }
+  return approachKernel<ExactMath>(params_, limits, x, y, theta, vel_x, vel_th, backward_motion);
+}
+
+void GracefulController::approachBatch(const double* x, const double* y, const double* theta,
+                                       double* vel_x, double* vel_th, size_t count,
+                                       bool backward_motion) const
+{
+  approachBatch(x, y, theta, limits_, vel_x, vel_th, count, backward_motion);
+}
+
+void GracefulController::approachBatch(const double* x, const double* y, const double* theta,
+                                       const VelocityLimits& limits,
+                                       double* vel_x, double* vel_th, size_t count,
+                                       bool backward_motion) const
+{
+  approachBatch(x, y, theta, limits, nullptr, vel_x, vel_th, count, backward_motion);
+}
+
+void GracefulController::approachBatch(const double* x, const double* y, const double* theta,
+                                       const VelocityLimits& limits, const double* max_abs_velocity,
+                                       double* vel_x, double* vel_th, size_t count,
+                                       bool backward_motion) const
+{
+  size_t done = 0;
+
+#if defined(GRACEFUL_CONTROLLER_HAVE_AVX512) || defined(GRACEFUL_CONTROLLER_HAVE_AVX2)
+  detail::BatchParameters params;
+  params.k1 = params_.k1;
+  params.k2 = params_.k2;
+  params.min_abs_velocity = limits.min_abs_velocity;
+  params.max_abs_velocity = limits.max_abs_velocity;
+  params.max_abs_velocities = max_abs_velocity;
+  params.max_decel = params_.max_decel;
+  params.max_abs_angular_velocity = limits.max_abs_angular_velocity;
+  params.beta = params_.beta;
+  params.lambda = params_.lambda;
+#endif
 
-  // Compute angular velocity
-  double w = k * v;
-  // Bound angular velocity
-  double bounded_w = std::min(max_abs_angular_velocity_, std::max(-max_abs_angular_velocity_, w));
-  // Make sure that if we reduce w, we reduce v so that kurvature is still followed
-  if (w != 0.0)
+  // Use the widest kernels this CPU supports, narrower ones pick up the remainder.
+  // The kernels use exact math, so other backends evaluate every target with approach().
+  const bool exact = math_backend_ == MathBackend::EXACT;
+#ifdef GRACEFUL_CONTROLLER_HAVE_AVX512
+  static const bool has_avx512 = __builtin_cpu_supports("avx512f");
+  if (exact && has_avx512)
   {
-    v *= (bounded_w/w);
+    done = detail::approachBatchAVX512(params, x, y, theta, vel_x, vel_th, count, backward_motion);
   }
+#endif
+#ifdef GRACEFUL_CONTROLLER_HAVE_AVX2
+  static const bool has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  if (exact && has_avx2)
+  {
+    if (max_abs_velocity)
+    {
+      params.max_abs_velocities = max_abs_velocity + done;
+    }
+    done += detail::approachBatchAVX2(params, x + done, y + done, theta + done,
+                                      vel_x + done, vel_th + done, count - done, backward_motion);
+  }
+#endif
 
-  // Send command to base
-  vel_x = v;
-  vel_th = bounded_w;
-  return true;
+  // Scalar fallback, also handles whatever does not fill a whole vector
+  VelocityLimits lane_limits = limits;
+  for (size_t i = done; i < count; ++i)
+  {
+    if (max_abs_velocity)
+    {
+      lane_limits.max_abs_velocity = max_abs_velocity[i];
+    }
+    approach(x[i], y[i], theta[i], lane_limits, vel_x[i], vel_th[i], backward_motion);
+  }
 }
 
 void GracefulController::setVelocityLimits(
@@ -95,9 +172,9 @@ void GracefulController::setVelocityLimits(
   const double max_abs_velocity,
   const double max_abs_angular_velocity)
 {
-  min_abs_velocity_ = min_abs_velocity;
-  max_abs_velocity_ = max_abs_velocity;
-  max_abs_angular_velocity_ = max_abs_angular_velocity;
+  limits_.min_abs_velocity = min_abs_velocity;
+  limits_.max_abs_velocity = max_abs_velocity;
+  limits_.max_abs_angular_velocity = max_abs_angular_velocity;
 }
 
 }  // namespace graceful_controller
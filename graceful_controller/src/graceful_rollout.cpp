@@ -0,0 +1,791 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <graceful_controller/graceful_rollout.hpp>
+
+namespace graceful_controller
+{
+
+constexpr size_t GracefulRollout::MAX_LANES;
+
+/**
+ * @brief Heading of a simulated pose, with its cosine and sine.
+ */
+struct Heading
+{
+  double yaw;
+  double cos_yaw;
+  double sin_yaw;
+};
+
+Heading headingFromAngle(double yaw)
+{
+  Heading heading;
+  heading.yaw = yaw;
+  heading.cos_yaw = std::cos(yaw);
+  heading.sin_yaw = std::sin(yaw);
+  return heading;
+}
+
+/**
+ * @brief Rotate a heading by multiplying its unit complex number (cos, sin)
+ * with that of the angle. Rollout steps usually turn by at most 0.1 rad, for
+ * which Taylor series up to the ninth order are within 1 ulp of std::cos()
+ * and std::sin(), so this usually needs no trigonometry at all. The result is
+ * renormalized so that rounding errors do not accumulate over a rollout.
+ */
+Heading rotateHeading(const Heading& heading, double angle)
+{
+  double cos_angle, sin_angle;
+  if (std::fabs(angle) <= 0.1)
+  {
+    double a2 = angle * angle;
+    cos_angle = 1.0 - a2 / 2.0 * (1.0 - a2 / 12.0 * (1.0 - a2 / 30.0 * (1.0 - a2 / 56.0)));
+    sin_angle = angle * (1.0 - a2 / 6.0 * (1.0 - a2 / 20.0 * (1.0 - a2 / 42.0 * (1.0 - a2 / 72.0))));
+  }
+  else
+  {
+    cos_angle = std::cos(angle);
+    sin_angle = std::sin(angle);
+  }
+
+  double c = heading.cos_yaw * cos_angle - heading.sin_yaw * sin_angle;
+  double s = heading.sin_yaw * cos_angle + heading.cos_yaw * sin_angle;
+  // One Newton step towards unit length
+  double scale = 1.5 - 0.5 * (c * c + s * s);
+
+  Heading result;
+  result.yaw = heading.yaw + angle;
+  result.cos_yaw = c * scale;
+  result.sin_yaw = s * scale;
+  return result;
+}
+
+/**
+ * @brief Target relative to the last simulated pose of an EULER rollout.
+ * @param last The last simulated pose, nullptr at the start.
+ * @param heading Heading of the last simulated pose.
+ * @param incremental Use the cosine and sine of the heading, rather than its angle.
+ * @param error_yaw Heading of the error, as used for in place rotation.
+ */
+void eulerError(const Pose2D& target, const Pose2D* last, const Heading& heading, bool incremental,
+                double& error_x, double& error_y, double& error_angle, double& error_yaw)
+{
+  error_x = target.x;
+  error_y = target.y;
+  error_angle = target.theta;
+  error_yaw = target.theta;
+
+  // Move origin to our current simulated pose
+  if (last)
+  {
+    double x = target.x - last->x;
+    double y = target.y - last->y;
+
+    if (incremental)
+    {
+      error_x = x * heading.cos_yaw + y * heading.sin_yaw;
+      error_y = y * heading.cos_yaw - x * heading.sin_yaw;
+      error_angle -= heading.yaw;
+      error_yaw = angles::normalize_angle(error_angle);
+      return;
+    }
+
+    double theta = -heading.yaw;
+    error_x = x * std::cos(theta) - y * std::sin(theta);
+    error_y = y * std::cos(theta) + x * std::sin(theta);
+
+    error_angle += theta;
+    error_yaw = quaternionYaw(error_angle);
+  }
+}
+
+/**
+ * @brief One EULER step of length resolution (or 0.1s while rotating in place).
+ * @param heading Heading of the last pose, updated to that of the returned pose.
+ */
+Pose2D eulerStep(const Pose2D* last, Heading& heading, bool incremental,
+                 double vel_x, double vel_th, double resolution)
+{
+  Pose2D next_pose = { 0.0, 0.0, 0.0 };
+  if (last)
+  {
+    next_pose = *last;
+  }
+  double dt = (vel_x > 0.0) ? resolution / vel_x : 0.1;
+  if (incremental)
+  {
+    next_pose.x += dt * vel_x * heading.cos_yaw;
+    next_pose.y += dt * vel_x * heading.sin_yaw;
+    heading = rotateHeading(heading, dt * vel_th);
+    next_pose.theta = heading.yaw;
+    return next_pose;
+  }
+  next_pose.x += dt * vel_x * std::cos(heading.yaw);
+  next_pose.y += dt * vel_x * std::sin(heading.yaw);
+  next_pose.theta = heading.yaw + dt * vel_th;
+  heading.yaw = quaternionYaw(next_pose.theta);
+  return next_pose;
+}
+
+GracefulRollout::GracefulRollout(const GracefulControllerConstPtr& controller, const RolloutParameters& params)
+  : controller_(controller),
+    params_(params)
+{
+}
+
+RolloutResult GracefulRollout::simulate(const Pose2D& target, const VelocityLimits& limits, bool initial_rotation,
+                                        const CollisionChecker& is_colliding, TrajectoryBuffer& trajectory) const
+{
+  if (params_.lazy_collision_checking && trajectory.footprint_scalings)
+  {
+    // Only record the footprint scaling of each pose while integrating
+    CollisionChecker record = [&trajectory](const Pose2D&, double footprint_scaling)
+    {
+      trajectory.footprint_scalings[trajectory.size - 1] = footprint_scaling;
+      return false;
+    };
+    RolloutResult result = (params_.integrator == RolloutIntegrator::ARC) ?
+                           simulateArc(target, limits, initial_rotation, record, trajectory) :
+                           simulateEuler(target, limits, initial_rotation, record, trajectory);
+    if (result.status == RolloutStatus::SUCCESS && checkLazily(is_colliding, trajectory))
+    {
+      result.status = RolloutStatus::COLLISION;
+    }
+    return result;
+  }
+
+  if (params_.integrator == RolloutIntegrator::ARC)
+  {
+    return simulateArc(target, limits, initial_rotation, is_colliding, trajectory);
+  }
+  return simulateEuler(target, limits, initial_rotation, is_colliding, trajectory);
+}
+
+bool GracefulRollout::checkLazily(const CollisionChecker& is_colliding, TrajectoryBuffer& trajectory) const
+{
+  size_t count = trajectory.size;
+  if (count == 0)
+  {
+    return false;
+  }
+
+  // The last pose first
+  if (is_colliding(trajectory.poses[count - 1], trajectory.footprint_scalings[count - 1]))
+  {
+    return true;
+  }
+
+  // Then pose k - 1 for the odd multiples k of each power of two below count,
+  // largest first, which checks every other pose exactly once
+  size_t stride = 1;
+  while (2 * stride < count)
+  {
+    stride *= 2;
+  }
+  for (; stride > 0; stride /= 2)
+  {
+    for (size_t k = stride; k < count; k += 2 * stride)
+    {
+      if (is_colliding(trajectory.poses[k - 1], trajectory.footprint_scalings[k - 1]))
+      {
+        trajectory.size = k;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+RolloutResult GracefulRollout::simulateEuler(const Pose2D& target, const VelocityLimits& limits,
+                                             bool initial_rotation, const CollisionChecker& is_colliding,
+                                             TrajectoryBuffer& trajectory) const
+{
+  RolloutResult result;
+  result.status = RolloutStatus::SUCCESS;
+  result.vel_x = 0.0;
+  result.vel_th = 0.0;
+  result.initially_aligned = false;
+  result.evaluations = 0;
+
+  trajectory.size = 0;
+
+  // Should we simulate rotation initially
+  bool rotating = initial_rotation && params_.initial_rotate_tolerance > 0.0;
+
+  // Heading of the last simulated pose (starts at the origin)
+  Heading heading = headingFromAngle(0.0);
+
+  // Get control and path, iteratively
+  while (true)
+  {
+    // The error between current simulated pose and the target pose
+    const Pose2D* last = (trajectory.size > 0) ? &trajectory.poses[trajectory.size - 1] : nullptr;
+    double error_x, error_y, error_angle, error_yaw;
+    eulerError(target, last, heading, params_.incremental_rotation, error_x, error_y, error_angle, error_yaw);
+
+    // Compute commands
+    double vel_x, vel_th;
+    bool was_rotating = rotating;
+    ++result.evaluations;
+    if (!computeCommand(error_x, error_y, error_angle, error_yaw, limits, rotating, vel_x, vel_th))
+    {
+      result.status = RolloutStatus::NO_SOLUTION;
+      return result;
+    }
+
+    if (trajectory.size == 0)
+    {
+      // First iteration of simulation, store our commands to the robot
+      result.vel_x = vel_x;
+      result.vel_th = vel_th;
+      result.initially_aligned = was_rotating && !rotating;
+    }
+    else if (std::hypot(error_x, error_y) < params_.resolution)
+    {
+      // We've simulated to the desired pose
+      result.status = RolloutStatus::SUCCESS;
+      return result;
+    }
+
+    if (trajectory.size == trajectory.capacity)
+    {
+      result.status = RolloutStatus::BUFFER_FULL;
+      return result;
+    }
+
+    // Forward simulate command, starting at the origin or last pose
+    Pose2D next_pose = eulerStep(last, heading, params_.incremental_rotation, vel_x, vel_th, params_.resolution);
+    trajectory.poses[trajectory.size++] = next_pose;
+
+    // Check next pose for collision
+    if (is_colliding(next_pose, footprintScaling(vel_x)))
+    {
+      result.status = RolloutStatus::COLLISION;
+      return result;
+    }
+  }
+}
+
+size_t GracefulRollout::simulateCaps(const Pose2D& target, const VelocityLimits& limits,
+                                     const double* max_velocities, size_t count, bool initial_rotation,
+                                     const CollisionChecker& is_colliding, TrajectoryBuffer* trajectories,
+                                     RolloutResult* results) const
+{
+  if (params_.integrator == RolloutIntegrator::EULER && !params_.lazy_collision_checking)
+  {
+    for (size_t first = 0; first < count; first += MAX_LANES)
+    {
+      size_t lanes = std::min(MAX_LANES, count - first);
+      size_t best = simulateLanes(target, limits, max_velocities + first, lanes, initial_rotation, is_colliding,
+                                  trajectories + first, results + first);
+      if (best < lanes)
+      {
+        return first + best;
+      }
+    }
+    return count;
+  }
+
+  // Adaptive steps do not line up between caps, and lazy checks are not made
+  // step by step, simulate them one at a time
+  VelocityLimits cap_limits = limits;
+  for (size_t i = 0; i < count; ++i)
+  {
+    cap_limits.max_abs_velocity = max_velocities[i];
+    results[i] = simulate(target, cap_limits, initial_rotation, is_colliding, trajectories[i]);
+    if (results[i].status == RolloutStatus::SUCCESS)
+    {
+      return i;
+    }
+  }
+  return count;
+}
+
+size_t GracefulRollout::simulateLanes(const Pose2D& target, const VelocityLimits& limits,
+                                      const double* max_velocities, size_t count, bool initial_rotation,
+                                      const CollisionChecker& is_colliding, TrajectoryBuffer* trajectories,
+                                      RolloutResult* results) const
+{
+  // State of each lane
+  Heading heading[MAX_LANES];
+  bool rotating[MAX_LANES];
+  bool running[MAX_LANES];
+  // Running lanes, packed for approachBatch()
+  size_t lane[MAX_LANES];
+  double error_x[MAX_LANES], error_y[MAX_LANES], error_angle[MAX_LANES], error_yaw[MAX_LANES];
+  double max_velocity[MAX_LANES], vel_x[MAX_LANES], vel_th[MAX_LANES];
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    results[i].status = RolloutStatus::SUCCESS;
+    results[i].vel_x = 0.0;
+    results[i].vel_th = 0.0;
+    results[i].initially_aligned = false;
+    results[i].evaluations = 0;
+    trajectories[i].size = 0;
+    heading[i] = headingFromAngle(0.0);
+    rotating[i] = initial_rotation && params_.initial_rotate_tolerance > 0.0;
+    running[i] = true;
+  }
+
+  // Fastest lane that reached the target, only faster lanes keep running
+  size_t best = count;
+  while (true)
+  {
+    size_t n = 0;
+    for (size_t i = 0; i < best; ++i)
+    {
+      if (running[i])
+      {
+        const TrajectoryBuffer& trajectory = trajectories[i];
+        const Pose2D* last = (trajectory.size > 0) ? &trajectory.poses[trajectory.size - 1] : nullptr;
+        eulerError(target, last, heading[i], params_.incremental_rotation,
+                   error_x[n], error_y[n], error_angle[n], error_yaw[n]);
+        max_velocity[n] = max_velocities[i];
+        lane[n++] = i;
+      }
+    }
+    if (n == 0)
+    {
+      return best;
+    }
+
+    // Control law for all running lanes at once, lanes still rotating in place ignore it
+    controller_->approachBatch(error_x, error_y, error_angle, limits, max_velocity, vel_x, vel_th, n);
+
+    for (size_t j = 0; j < n; ++j)
+    {
+      size_t i = lane[j];
+      if (!running[i])
+      {
+        // Abandoned earlier in this step
+        continue;
+      }
+      RolloutResult& result = results[i];
+      TrajectoryBuffer& trajectory = trajectories[i];
+
+      // Same as computeCommand()
+      bool was_rotating = rotating[i];
+      ++result.evaluations;
+      if (rotating[i])
+      {
+        double rotation_yaw = (std::hypot(error_x[j], error_y[j]) > 0.5) ? std::atan2(error_y[j], error_x[j]) :
+                                                                            error_yaw[j];
+        if (std::fabs(rotation_yaw) < params_.initial_rotate_tolerance)
+        {
+          rotating[i] = false;
+        }
+        else
+        {
+          vel_x[j] = 0.0;
+          vel_th[j] = rotationVelocity(rotation_yaw);
+        }
+      }
+
+      if (trajectory.size == 0)
+      {
+        // First iteration of simulation, store our commands to the robot
+        result.vel_x = vel_x[j];
+        result.vel_th = vel_th[j];
+        result.initially_aligned = was_rotating && !rotating[i];
+      }
+      else if (std::hypot(error_x[j], error_y[j]) < params_.resolution)
+      {
+        // We've simulated to the desired pose, slower lanes can no longer win
+        running[i] = false;
+        for (size_t k = i + 1; k < best; ++k)
+        {
+          if (running[k])
+          {
+            running[k] = false;
+            results[k].status = RolloutStatus::ABANDONED;
+          }
+        }
+        best = i;
+        continue;
+      }
+
+      if (trajectory.size == trajectory.capacity)
+      {
+        result.status = RolloutStatus::BUFFER_FULL;
+        running[i] = false;
+        continue;
+      }
+
+      // Forward simulate command, starting at the origin or last pose
+      const Pose2D* last = (trajectory.size > 0) ? &trajectory.poses[trajectory.size - 1] : nullptr;
+      Pose2D next_pose = eulerStep(last, heading[i], params_.incremental_rotation, vel_x[j], vel_th[j],
+                                   params_.resolution);
+      trajectory.poses[trajectory.size++] = next_pose;
+
+      // Check next pose for collision
+      if (is_colliding(next_pose, footprintScaling(vel_x[j])))
+      {
+        result.status = RolloutStatus::COLLISION;
+        running[i] = false;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Pose after following a constant (v, w) arc for dt.
+ * @param start_heading Heading of the start pose.
+ * @param incremental Rotate the start heading, rather than computing the end heading from its angle.
+ * @param end_heading Returned heading of the end pose.
+ */
+Pose2D arcPose(const Pose2D& start, const Heading& start_heading, bool incremental,
+               double vel_x, double vel_th, double dt, Heading& end_heading)
+{
+  Pose2D pose;
+  double dtheta = vel_th * dt;
+  pose.theta = start.theta + dtheta;
+  end_heading = incremental ? rotateHeading(start_heading, dtheta) : headingFromAngle(pose.theta);
+  if (std::fabs(dtheta) < 1e-9)
+  {
+    // Straight line, avoid dividing by (nearly) zero
+    pose.x = start.x + vel_x * dt * start_heading.cos_yaw;
+    pose.y = start.y + vel_x * dt * start_heading.sin_yaw;
+  }
+  else
+  {
+    double radius = vel_x / vel_th;
+    pose.x = start.x + radius * (end_heading.sin_yaw - start_heading.sin_yaw);
+    pose.y = start.y - radius * (end_heading.cos_yaw - start_heading.cos_yaw);
+  }
+  return pose;
+}
+
+RolloutResult GracefulRollout::simulateArc(const Pose2D& target, const VelocityLimits& limits,
+                                           bool initial_rotation, const CollisionChecker& is_colliding,
+                                           TrajectoryBuffer& trajectory) const
+{
+  RolloutResult result;
+  result.status = RolloutStatus::SUCCESS;
+  result.initially_aligned = false;
+  result.evaluations = 0;
+
+  trajectory.size = 0;
+
+  bool rotating = initial_rotation && params_.initial_rotate_tolerance > 0.0;
+
+  // Computes the command at pose, returns the distance to the target
+  auto command = [&](const Pose2D& pose, const Heading& heading, bool& rotating,
+                     double& vel_x, double& vel_th, double& distance)
+  {
+    double x = target.x - pose.x;
+    double y = target.y - pose.y;
+    double error_x = x * heading.cos_yaw + y * heading.sin_yaw;
+    double error_y = y * heading.cos_yaw - x * heading.sin_yaw;
+    double error_angle = target.theta - pose.theta;
+    distance = std::hypot(error_x, error_y);
+    ++result.evaluations;
+    return computeCommand(error_x, error_y, error_angle, angles::normalize_angle(error_angle), limits,
+                          rotating, vel_x, vel_th);
+  };
+
+  // Command at the start pose
+  Pose2D pose = { 0.0, 0.0, 0.0 };
+  Heading heading = headingFromAngle(0.0);
+  double vel_x, vel_th, distance;
+  bool was_rotating = rotating;
+  if (!command(pose, heading, rotating, vel_x, vel_th, distance))
+  {
+    result.status = RolloutStatus::NO_SOLUTION;
+    return result;
+  }
+  result.vel_x = vel_x;
+  result.vel_th = vel_th;
+  result.initially_aligned = was_rotating && !rotating;
+
+  double step_length = params_.resolution;
+  while (true)
+  {
+    // Don't step (much) past the target
+    double length = std::max(params_.resolution, std::min(step_length, distance));
+
+    // Try the step, shortening it while holding the command constant is not accurate enough.
+    // The command at the end of the step is the command for the next step.
+    Pose2D next_pose;
+    Heading next_heading;
+    double dt, next_vel_x, next_vel_th, next_distance;
+    bool next_rotating;
+    double heading_error = 0.0;
+    while (true)
+    {
+      dt = (vel_x > 0.0) ? length / vel_x : 0.1;
+      next_pose = arcPose(pose, heading, params_.incremental_rotation, vel_x, vel_th, dt, next_heading);
+      next_rotating = rotating;
+      if (!command(next_pose, next_heading, next_rotating, next_vel_x, next_vel_th, next_distance))
+      {
+        result.status = RolloutStatus::NO_SOLUTION;
+        return result;
+      }
+      if (rotating || next_rotating || vel_x <= 0.0 || next_vel_x <= 0.0)
+      {
+        // In place rotation uses fixed time steps
+        break;
+      }
+      // The curvature changes (roughly linearly) over the step,
+      // holding it constant gives a heading error of half the change
+      heading_error = 0.5 * std::fabs(next_vel_th / next_vel_x - vel_th / vel_x) * length;
+      if (heading_error <= params_.max_heading_error || length <= params_.resolution)
+      {
+        break;
+      }
+      length = std::max(params_.resolution, 0.5 * length);
+    }
+
+    // Collision check along the arc, such that no point of the
+    // footprint moves more than one resolution between checks
+    double sweep = std::fabs(vel_x * dt) + params_.footprint_radius * std::fabs(vel_th * dt);
+    size_t checks = std::max(1.0, std::ceil(sweep / params_.resolution));
+    double footprint_scaling = footprintScaling(vel_x);
+    for (size_t i = 1; i <= checks; ++i)
+    {
+      if (trajectory.size == trajectory.capacity)
+      {
+        result.status = RolloutStatus::BUFFER_FULL;
+        return result;
+      }
+      Heading checked_heading;
+      Pose2D checked_pose = (i == checks) ? next_pose :
+                            arcPose(pose, heading, params_.incremental_rotation, vel_x, vel_th, dt * i / checks,
+                                    checked_heading);
+      trajectory.poses[trajectory.size++] = checked_pose;
+      if (is_colliding(checked_pose, footprint_scaling))
+      {
+        result.status = RolloutStatus::COLLISION;
+        return result;
+      }
+    }
+
+    if (next_distance < params_.resolution)
+    {
+      // We've simulated to the desired pose
+      result.status = RolloutStatus::SUCCESS;
+      return result;
+    }
+
+    // Grow the step if this one was comfortably accurate
+    if (heading_error < 0.25 * params_.max_heading_error)
+    {
+      step_length = std::min(params_.max_step_length, 2.0 * length);
+    }
+    else
+    {
+      step_length = length;
+    }
+
+    pose = next_pose;
+    heading = next_heading;
+    vel_x = next_vel_x;
+    vel_th = next_vel_th;
+    distance = next_distance;
+    rotating = next_rotating;
+  }
+}
+
+bool GracefulRollout::computeCommand(double error_x, double error_y, double error_angle, double error_yaw,
+                                     const VelocityLimits& limits, bool& rotating,
+                                     double& vel_x, double& vel_th) const
+{
+  if (rotating)
+  {
+    // Point towards the target if it is far away, otherwise align heading
+    double rotation_yaw = (std::hypot(error_x, error_y) > 0.5) ? std::atan2(error_y, error_x) : error_yaw;
+    vel_x = 0.0;
+    vel_th = rotationVelocity(rotation_yaw);
+    if (std::fabs(rotation_yaw) < params_.initial_rotate_tolerance)
+    {
+      rotating = false;
+    }
+  }
+
+  if (!rotating)
+  {
+    return controller_->approach(error_x, error_y, error_angle, limits, vel_x, vel_th);
+  }
+  return true;
+}
+
+double GracefulRollout::footprintScaling(double vel_x) const
+{
+  double footprint_scaling = 1.0;
+  if (vel_x > params_.scaling_vel_x)
+  {
+    // Scaling = (vel_x - scaling_vel_x) / (max_vel_x - scaling_vel_x)
+    double ratio = params_.max_vel_x - params_.scaling_vel_x;
+    // Avoid divide by zero
+    if (ratio > 0)
+    {
+      ratio = (vel_x - params_.scaling_vel_x) / ratio;
+      footprint_scaling += ratio * params_.scaling_factor;
+    }
+  }
+  return footprint_scaling;
+}
+
+double GracefulRollout::rotationVelocity(double yaw) const
+{
+  double vel_th = std::sqrt(2 * params_.acc_lim_theta * std::fabs(yaw));
+  vel_th = std::min(params_.max_vel_theta, std::max(params_.min_in_place_vel_theta, vel_th));
+  return (yaw < 0.0) ? -vel_th : vel_th;
+}
+
+size_t bisectCaps(size_t count, size_t verify_steps, const std::function<bool(size_t)>& reaches)
+{
+  if (count == 0 || reaches(0))
+  {
+    return 0;
+  }
+  if (count == 1 || !reaches(count - 1))
+  {
+    return count;
+  }
+
+  // Cap lo fails and cap hi reaches the target. The caps that failed are
+  // remembered, in increasing order, so that verification can skip them.
+  size_t failed[64];
+  size_t failures = 0;
+  size_t lo = 0;
+  size_t hi = count - 1;
+  failed[failures++] = lo;
+  while (hi - lo > 1)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    if (reaches(mid))
+    {
+      hi = mid;
+    }
+    else
+    {
+      lo = mid;
+      failed[failures++] = lo;
+    }
+  }
+
+  // Try the skipped caps just faster than the answer
+  size_t best = hi;
+  for (size_t i = hi; i-- > 1 && verify_steps > 0;)
+  {
+    if (failures > 0 && failed[failures - 1] == i)
+    {
+      --failures;
+      continue;
+    }
+    --verify_steps;
+    if (reaches(i))
+    {
+      best = i;
+    }
+  }
+  return best;
+}
+
+size_t gallopSearch(size_t count, size_t verify_steps, const std::function<bool(size_t)>& passes,
+                    std::vector<char>& outcomes, bool& monotone)
+{
+  monotone = true;
+  if (count == 0)
+  {
+    return 0;
+  }
+
+  // Outcome of each candidate tried, so that none is evaluated twice
+  enum Outcome : char
+  {
+    UNKNOWN,
+    FAILED,
+    PASSED
+  };
+  outcomes.assign(count, UNKNOWN);
+  auto probe = [&](size_t i)
+  {
+    if (outcomes[i] == UNKNOWN)
+    {
+      outcomes[i] = passes(i) ? PASSED : FAILED;
+    }
+    return outcomes[i] == PASSED;
+  };
+
+  // Gallop until a candidate passes, lo is the last one that failed
+  size_t lo = count;
+  size_t hi = 0;
+  size_t stride = 1;
+  while (hi < count && !probe(hi))
+  {
+    lo = hi;
+    hi = (hi == count - 1) ? count : std::min(hi + stride, count - 1);
+    stride *= 2;
+  }
+
+  // Every candidate tried before hi failed, and hi passed, which agrees with the
+  // assumption. Only a candidate after hi that fails contradicts it.
+  bool contradicted = (hi == count);
+  if (hi < count)
+  {
+    // Bisect between the last failure and the first success
+    while (lo != count && hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (probe(mid))
+      {
+        hi = mid;
+      }
+      else
+      {
+        lo = mid;
+      }
+    }
+
+    // Optionally check the assumption, galloping on from the answer
+    size_t step = 1;
+    for (size_t i = 0; i < verify_steps && !contradicted && hi + 1 < count; ++i)
+    {
+      size_t next = std::min(hi + step, count - 1);
+      contradicted = !probe(next);
+      if (next == count - 1)
+      {
+        break;
+      }
+      step *= 2;
+    }
+  }
+  if (!contradicted)
+  {
+    return hi;
+  }
+
+  // Nothing passed, or a candidate failed after hi passed: skipped candidates may
+  // pass, try those before hi in order
+  for (size_t i = 0; i < hi; ++i)
+  {
+    if (probe(i))
+    {
+      // Found one that the gallop and the bisection skipped
+      monotone = false;
+      return i;
+    }
+  }
+  return hi;
+}
+
+}  // namespace graceful_controller
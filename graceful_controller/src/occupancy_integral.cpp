@@ -0,0 +1,156 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <graceful_controller/occupancy_integral.hpp>
+
+namespace graceful_controller
+{
+
+// Whether any cell of a row is on the other side of the threshold than in occupied
+static bool rowChanged(const unsigned char* costs, const unsigned char* occupied, unsigned int count,
+                       unsigned char threshold)
+{
+  unsigned char changed = 0;
+  unsigned int x = 0;
+#ifdef __SSE2__
+  __m128i threshold16 = _mm_set1_epi8(static_cast<char>(threshold));
+  __m128i ones = _mm_set1_epi8(1);
+  __m128i changed16 = _mm_setzero_si128();
+  for (; x + 16 <= count; x += 16)
+  {
+    __m128i cost = _mm_loadu_si128(reinterpret_cast<const __m128i*>(costs + x));
+    // All ones where cost >= threshold, unsigned
+    __m128i above = _mm_cmpeq_epi8(_mm_max_epu8(cost, threshold16), cost);
+    __m128i before = _mm_loadu_si128(reinterpret_cast<const __m128i*>(occupied + x));
+    changed16 = _mm_or_si128(changed16, _mm_xor_si128(_mm_and_si128(above, ones), before));
+  }
+  changed = _mm_movemask_epi8(_mm_cmpeq_epi8(changed16, _mm_setzero_si128())) != 0xFFFF;
+#endif
+  for (; x < count; ++x)
+  {
+    changed |= static_cast<unsigned char>(costs[x] >= threshold) ^ occupied[x];
+  }
+  return changed;
+}
+
+OccupancyIntegral::OccupancyIntegral(unsigned char threshold)
+  : threshold_(threshold), size_x_(0), size_y_(0), resolution_(0.0), origin_x_(0.0), origin_y_(0.0), table_(1, 0)
+{
+}
+
+size_t OccupancyIntegral::update(const CostGrid& grid)
+{
+  // First column and row of the cells that changed, every cell of a grid of a new size
+  unsigned int min_x = grid.size_x;
+  unsigned int min_y = grid.size_y;
+  if (grid.size_x != size_x_ || grid.size_y != size_y_ || occupied_.empty())
+  {
+    size_x_ = grid.size_x;
+    size_y_ = grid.size_y;
+    occupied_.assign(static_cast<size_t>(size_x_) * size_y_, 0);
+    table_.assign(static_cast<size_t>(size_x_ + 1) * (size_y_ + 1), 0);
+    min_x = 0;
+    min_y = 0;
+  }
+  resolution_ = grid.resolution;
+  origin_x_ = grid.origin_x;
+  origin_y_ = grid.origin_y;
+
+  for (unsigned int y = 0; y < size_y_; ++y)
+  {
+    const unsigned char* costs = grid.costs + static_cast<size_t>(y) * size_x_;
+    unsigned char* occupied = &occupied_[static_cast<size_t>(y) * size_x_];
+
+    // Most rows did not change
+    if (!rowChanged(costs, occupied, size_x_, threshold_))
+    {
+      continue;
+    }
+
+    for (unsigned int x = 0; x < size_x_; ++x)
+    {
+      unsigned char cell = costs[x] >= threshold_;
+      if (cell != occupied[x])
+      {
+        occupied[x] = cell;
+        min_x = std::min(min_x, x);
+      }
+    }
+    min_y = std::min(min_y, y);
+  }
+  if (min_x == size_x_ || min_y == size_y_)
+  {
+    return 0;
+  }
+
+  // Entries before column min_x + 1 or row min_y + 1 only count cells that did not change
+  size_t stride = size_x_ + 1;
+  for (unsigned int y = min_y; y < size_y_; ++y)
+  {
+    const unsigned char* occupied = &occupied_[static_cast<size_t>(y) * size_x_];
+    const uint32_t* above = &table_[y * stride];
+    uint32_t* row = &table_[(y + 1) * stride];
+    uint32_t row_sum = row[min_x] - above[min_x];
+    for (unsigned int x = min_x; x < size_x_; ++x)
+    {
+      row_sum += occupied[x];
+      row[x + 1] = above[x + 1] + row_sum;
+    }
+  }
+  return static_cast<size_t>(size_x_ - min_x) * (size_y_ - min_y);
+}
+
+bool OccupancyIntegral::isColliding(const FootprintTemplates& templates, double x, double y, double yaw,
+                                    double scaling) const
+{
+  if (x < origin_x_ || y < origin_y_)
+  {
+    return true;
+  }
+  long mx = static_cast<long>((x - origin_x_) / resolution_);
+  long my = static_cast<long>((y - origin_y_) / resolution_);
+
+  size_t count;
+  const FootprintRectangle* rectangles = templates.getRectangles(yaw, scaling, count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    long x_begin = mx + rectangles[i].x_begin;
+    long x_end = mx + rectangles[i].x_end;
+    long y_begin = my + rectangles[i].y_begin;
+    long y_end = my + rectangles[i].y_end;
+    if (x_begin < 0 || y_begin < 0 || x_end > size_x_ || y_end > size_y_)
+    {
+      // Off the grid
+      return true;
+    }
+    if (this->count(x_begin, y_begin, x_end, y_end) > 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace graceful_controller
@@ -0,0 +1,239 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <graceful_controller/rollout_cache.hpp>
+
+namespace graceful_controller
+{
+
+// End of the least recently used list
+static constexpr size_t NONE = std::numeric_limits<size_t>::max();
+
+size_t RolloutCache::KeyHash::operator()(const Key& key) const
+{
+  size_t hash = std::hash<int64_t>()(key.x);
+  hash = hash * 31 + std::hash<int64_t>()(key.y);
+  hash = hash * 31 + std::hash<int64_t>()(key.theta);
+  hash = hash * 31 + std::hash<int64_t>()(key.max_velocity);
+  hash = hash * 31 + std::hash<int64_t>()(key.max_rotation_velocity);
+  return hash * 2 + key.initial_rotation;
+}
+
+RolloutCache::RolloutCache(size_t max_entries, size_t max_poses, size_t max_checks,
+                           double resolution, double velocity_resolution)
+  : max_entries_(max_entries),
+    max_poses_(max_poses),
+    max_checks_(max_checks),
+    inverse_resolution_(1.0 / resolution),
+    inverse_velocity_resolution_(1.0 / velocity_resolution),
+    entries_(max_entries),
+    poses_(max_entries * max_poses),
+    checks_(max_entries * max_checks),
+    head_(NONE),
+    tail_(NONE),
+    unused_(0),
+    hits_(0),
+    misses_(0)
+{
+  recorded_.reserve(max_checks);
+  index_.reserve(max_entries);
+}
+
+RolloutResult RolloutCache::simulate(const GracefulRollout& rollout, const Pose2D& target,
+                                     const VelocityLimits& limits, bool initial_rotation,
+                                     const CollisionChecker& is_colliding, uint64_t generation,
+                                     TrajectoryBuffer& trajectory)
+{
+  Key key = makeKey(target, limits.max_abs_velocity, rollout.getParameters().max_vel_theta, initial_rotation);
+  auto found = index_.find(key);
+  if (found != index_.end())
+  {
+    size_t i = found->second;
+    Entry& entry = entries_[i];
+    if (entry.min_abs_velocity == limits.min_abs_velocity &&
+        entry.max_abs_angular_velocity == limits.max_abs_angular_velocity &&
+        entry.pose_count <= trajectory.capacity)
+    {
+      ++hits_;
+      unlink(i);
+      pushFront(i);
+
+      RolloutResult result = entry.result;
+      result.evaluations = 0;
+      size_t pose_count = entry.pose_count;
+      if (entry.generation != generation)
+      {
+        // The costmap or the robot moved, check again
+        const Check* checks = &checks_[i * max_checks_];
+        bool colliding = false;
+        for (size_t j = 0; j < entry.check_count; ++j)
+        {
+          if (is_colliding(checks[j].pose, checks[j].footprint_scaling))
+          {
+            result.status = RolloutStatus::COLLISION;
+            pose_count = checks[j].trajectory_size;
+            colliding = true;
+            break;
+          }
+        }
+        if (!colliding)
+        {
+          entry.generation = generation;
+        }
+      }
+
+      const Pose2D* poses = &poses_[i * max_poses_];
+      std::copy(poses, poses + pose_count, trajectory.poses);
+      trajectory.size = pose_count;
+      return result;
+    }
+  }
+
+  ++misses_;
+
+  // Record the collision checks, so that they can be replayed on a hit
+  recorded_.clear();
+  bool overflow = false;
+  CollisionChecker recording = [this, &overflow, &trajectory, &is_colliding](const Pose2D& pose,
+                                                                              double footprint_scaling)
+  {
+    if (recorded_.size() < max_checks_)
+    {
+      // Lazy checks are made once the trajectory is complete, of poses stored in it.
+      // Other checks are of the last pose stored, or of poses between steps.
+      size_t trajectory_size = trajectory.size;
+      if (&pose >= trajectory.poses && &pose < trajectory.poses + trajectory.size)
+      {
+        trajectory_size = &pose - trajectory.poses + 1;
+      }
+      recorded_.push_back({ pose, footprint_scaling, trajectory_size });
+    }
+    else
+    {
+      overflow = true;
+    }
+    return is_colliding(pose, footprint_scaling);
+  };
+  RolloutResult result = rollout.simulate(target, limits, initial_rotation, recording, trajectory);
+
+  if (result.status == RolloutStatus::COLLISION || overflow || trajectory.size > max_poses_ || max_entries_ == 0)
+  {
+    // Nothing worth keeping, or it does not fit
+    return result;
+  }
+
+  // Store in place of the same key, a never used entry, or the least recently used one
+  size_t i;
+  if (found != index_.end())
+  {
+    i = found->second;
+    unlink(i);
+  }
+  else if (unused_ < max_entries_)
+  {
+    i = unused_++;
+  }
+  else
+  {
+    i = tail_;
+    unlink(i);
+    index_.erase(entries_[i].key);
+  }
+
+  Entry& entry = entries_[i];
+  entry.key = key;
+  entry.min_abs_velocity = limits.min_abs_velocity;
+  entry.max_abs_angular_velocity = limits.max_abs_angular_velocity;
+  entry.result = result;
+  entry.generation = generation;
+  entry.pose_count = trajectory.size;
+  entry.check_count = recorded_.size();
+  std::copy(trajectory.poses, trajectory.poses + trajectory.size, &poses_[i * max_poses_]);
+  std::copy(recorded_.begin(), recorded_.end(), &checks_[i * max_checks_]);
+  pushFront(i);
+  index_[key] = i;
+
+  return result;
+}
+
+void RolloutCache::clear()
+{
+  index_.clear();
+  head_ = NONE;
+  tail_ = NONE;
+  unused_ = 0;
+}
+
+RolloutCache::Key RolloutCache::makeKey(const Pose2D& target, double max_velocity, double max_rotation_velocity,
+                                        bool initial_rotation) const
+{
+  Key key;
+  key.x = std::llround(target.x * inverse_resolution_);
+  key.y = std::llround(target.y * inverse_resolution_);
+  key.theta = std::llround(target.theta * inverse_resolution_);
+  key.max_velocity = std::llround(max_velocity * inverse_velocity_resolution_);
+  // Only the initial rotation is limited by it
+  key.max_rotation_velocity =
+      initial_rotation ? std::llround(max_rotation_velocity * inverse_velocity_resolution_) : 0;
+  key.initial_rotation = initial_rotation;
+  return key;
+}
+
+void RolloutCache::unlink(size_t entry)
+{
+  Entry& e = entries_[entry];
+  if (e.prev != NONE)
+  {
+    entries_[e.prev].next = e.next;
+  }
+  else
+  {
+    head_ = e.next;
+  }
+  if (e.next != NONE)
+  {
+    entries_[e.next].prev = e.prev;
+  }
+  else
+  {
+    tail_ = e.prev;
+  }
+}
+
+void RolloutCache::pushFront(size_t entry)
+{
+  Entry& e = entries_[entry];
+  e.prev = NONE;
+  e.next = head_;
+  if (head_ != NONE)
+  {
+    entries_[head_].prev = entry;
+  }
+  else
+  {
+    tail_ = entry;
+  }
+  head_ = entry;
+}
+
+}  // namespace graceful_controller
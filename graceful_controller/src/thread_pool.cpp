@@ -0,0 +1,200 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <limits>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <graceful_controller/thread_pool.hpp>
+
+namespace graceful_controller
+{
+
+ThreadPool::ThreadPool(size_t workers, const std::vector<int>& cpus)
+  : task_(nullptr), batch_(0), running_(0), stop_(false)
+{
+  for (size_t i = 0; i < workers; ++i)
+  {
+    queues_.emplace_back(new Queue());
+  }
+  for (size_t i = 0; i < workers; ++i)
+  {
+    threads_.emplace_back(&ThreadPool::work, this, i);
+#ifdef __linux__
+    if (!cpus.empty())
+    {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpus[i % cpus.size()], &set);
+      pthread_setaffinity_np(threads_.back().native_handle(), sizeof(set), &set);
+    }
+#endif
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (std::thread& thread : threads_)
+  {
+    thread.join();
+  }
+}
+
+void ThreadPool::run(size_t count, const Task& task)
+{
+  std::lock_guard<std::mutex> run_lock(run_mutex_);
+  if (count == 0)
+  {
+    return;
+  }
+  if (threads_.empty())
+  {
+    // Nothing to hand the work to
+    for (size_t i = 0; i < count; ++i)
+    {
+      task(i, 0);
+    }
+    return;
+  }
+
+  // Deal the indices, the workers are idle so the queues need no locking
+  for (size_t w = 0; w < queues_.size(); ++w)
+  {
+    queues_[w]->indices.clear();
+    queues_[w]->head = 0;
+  }
+  for (size_t i = 0; i < count; ++i)
+  {
+    queues_[i % queues_.size()]->indices.push_back(i);
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  task_ = &task;
+  running_ = threads_.size();
+  ++batch_;
+  start_.notify_all();
+  done_.wait(lock, [this] { return running_ == 0; });
+  task_ = nullptr;
+}
+
+void ThreadPool::work(size_t worker)
+{
+  uint64_t batch = 0;
+  while (true)
+  {
+    const Task* task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_.wait(lock, [this, batch] { return stop_ || batch_ != batch; });
+      if (stop_)
+      {
+        return;
+      }
+      batch = batch_;
+      task = task_;
+    }
+
+    size_t index;
+    while (next(worker, index))
+    {
+      (*task)(index, worker);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--running_ == 0)
+    {
+      done_.notify_one();
+    }
+  }
+}
+
+bool ThreadPool::next(size_t worker, size_t& index)
+{
+  {
+    Queue& own = *queues_[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (own.head < own.indices.size())
+    {
+      index = own.indices[own.head++];
+      return true;
+    }
+  }
+
+  // Steal the lowest index left, retrying if someone else got to it first
+  while (true)
+  {
+    size_t victim = queues_.size();
+    size_t lowest = std::numeric_limits<size_t>::max();
+    for (size_t w = 0; w < queues_.size(); ++w)
+    {
+      Queue& queue = *queues_[w];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.head < queue.indices.size() && queue.indices[queue.head] < lowest)
+      {
+        lowest = queue.indices[queue.head];
+        victim = w;
+      }
+    }
+    if (victim == queues_.size())
+    {
+      // Every queue is empty
+      return false;
+    }
+
+    Queue& queue = *queues_[victim];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.head < queue.indices.size())
+    {
+      index = queue.indices[queue.head++];
+      return true;
+    }
+  }
+}
+
+size_t findFirstSuccess(ThreadPool& pool, size_t count, const CandidateEvaluator& evaluate)
+{
+  std::atomic<size_t> first(count);
+  pool.run(count, [&evaluate, &first](size_t candidate, size_t worker)
+  {
+    if (candidate > first.load())
+    {
+      // Something better already passed
+      return;
+    }
+    if (evaluate(candidate, worker, first))
+    {
+      // Lower the bound, unless another worker found a better candidate meanwhile
+      size_t current = first.load();
+      while (candidate < current && !first.compare_exchange_weak(current, candidate))
+      {
+      }
+    }
+  });
+  return first.load();
+}
+
+}  // namespace graceful_controller
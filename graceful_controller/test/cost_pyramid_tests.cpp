@@ -0,0 +1,175 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <graceful_controller/cost_pyramid.hpp>
+
+using graceful_controller::CostGrid;
+using graceful_controller::CostPyramid;
+
+// Every cell of every level holds the highest cost of the cells it covers
+static void expectConsistent(const CostPyramid& pyramid, const CostGrid& grid)
+{
+  for (size_t level = 0; level < pyramid.getLevels(); ++level)
+  {
+    unsigned int size = 1u << level;
+    for (unsigned int y = 0; y * size < grid.size_y; ++y)
+    {
+      for (unsigned int x = 0; x * size < grid.size_x; ++x)
+      {
+        unsigned char expected = 0;
+        for (unsigned int cy = y * size; cy < std::min((y + 1) * size, grid.size_y); ++cy)
+        {
+          for (unsigned int cx = x * size; cx < std::min((x + 1) * size, grid.size_x); ++cx)
+          {
+            expected = std::max(expected, grid.getCost(cx, cy));
+          }
+        }
+        ASSERT_EQ(expected, pyramid.getCost(level, x, y)) << "level " << level << ", cell " << x << " " << y;
+      }
+    }
+  }
+}
+
+TEST(CostPyramidTests, test_incremental_update)
+{
+  // Odd sizes, so that coarse cells are partly off the grid
+  std::vector<unsigned char> costs(37 * 23, 0);
+  CostGrid grid = { costs.data(), 37, 23, 0.05, 0.0, 0.0 };
+  CostPyramid pyramid(4);
+  EXPECT_EQ(4u, pyramid.getLevels());
+
+  std::mt19937 random(42);
+  std::uniform_int_distribution<int> cost(0, 200);
+  for (unsigned char& cell : costs)
+  {
+    cell = cost(random);
+  }
+  EXPECT_EQ(19u * 12u + 10u * 6u + 5u * 3u, pyramid.update(grid));
+  expectConsistent(pyramid, grid);
+
+  std::uniform_int_distribution<unsigned int> column(0, 36), row(0, 22);
+  for (int round = 0; round < 50; ++round)
+  {
+    // Nothing changed, nothing to do
+    EXPECT_EQ(0u, pyramid.update(grid));
+
+    // A cell changes, only the cells above it are recomputed
+    unsigned int x = column(random), y = row(random);
+    costs[y * 37 + x] = (round % 2) ? graceful_controller::LETHAL_COST : 0;
+    size_t recomputed = pyramid.update(grid);
+    EXPECT_LE(recomputed, 3u);
+    expectConsistent(pyramid, grid);
+
+    // A few cells far apart change, the box between them is recomputed
+    costs[row(random) * 37 + column(random)] = cost(random);
+    costs[row(random) * 37 + column(random)] = cost(random);
+    pyramid.update(grid);
+    expectConsistent(pyramid, grid);
+  }
+
+  // A new size starts over
+  std::vector<unsigned char> larger(40 * 30, graceful_controller::LETHAL_COST);
+  grid = { larger.data(), 40, 30, 0.05, 0.0, 0.0 };
+  pyramid.update(grid);
+  expectConsistent(pyramid, grid);
+}
+
+TEST(CostPyramidTests, test_is_below)
+{
+  std::vector<unsigned char> costs(64 * 48, 0);
+  CostGrid grid = { costs.data(), 64, 48, 0.05, 0.0, 0.0 };
+  std::mt19937 random(42);
+  std::uniform_int_distribution<unsigned int> column(0, 63), row(0, 47);
+
+  // A few obstacles over a gradient of low costs
+  for (unsigned int y = 0; y < 48; ++y)
+  {
+    for (unsigned int x = 0; x < 64; ++x)
+    {
+      costs[y * 64 + x] = (x + y) % 100;
+    }
+  }
+  for (int i = 0; i < 10; ++i)
+  {
+    costs[row(random) * 64 + column(random)] = graceful_controller::LETHAL_COST;
+  }
+  CostPyramid pyramid(5);
+  pyramid.update(grid);
+
+  // Boxes of any size and place are answered exactly
+  for (int query = 0; query < 2000; ++query)
+  {
+    unsigned int x0 = column(random), x1 = column(random), y0 = row(random), y1 = row(random);
+    unsigned int x_begin = std::min(x0, x1), x_end = std::max(x0, x1) + 1;
+    unsigned int y_begin = std::min(y0, y1), y_end = std::max(y0, y1) + 1;
+    unsigned char threshold = (query % 2) ? graceful_controller::INSCRIBED_COST : 90;
+    bool expected = true;
+    for (unsigned int y = y_begin; y < y_end; ++y)
+    {
+      for (unsigned int x = x_begin; x < x_end; ++x)
+      {
+        expected &= grid.getCost(x, y) < threshold;
+      }
+    }
+    EXPECT_EQ(expected, pyramid.isBelow(x_begin, y_begin, x_end, y_end, threshold))
+        << x_begin << " " << y_begin << " " << x_end << " " << y_end;
+  }
+  EXPECT_TRUE(pyramid.isBelow(5, 5, 5, 10, 0));
+}
+
+TEST(CostPyramidTests, test_is_free)
+{
+  std::vector<unsigned char> costs(100 * 100, 0);
+  CostGrid grid = { costs.data(), 100, 100, 0.05, -2.5, -2.5 };
+  CostPyramid pyramid;
+  EXPECT_FALSE(pyramid.isFree(0.0, 0.0, 0.3));
+
+  pyramid.update(grid);
+  EXPECT_TRUE(pyramid.isFree(0.0, 0.0, 0.3));
+
+  // Obstacles within the radius, on either axis, are not free, inflation is
+  unsigned int mx, my;
+  ASSERT_TRUE(grid.worldToMap(0.28, -0.28, mx, my));
+  costs[my * 100 + mx] = graceful_controller::INSCRIBED_COST;
+  pyramid.update(grid);
+  EXPECT_FALSE(pyramid.isFree(0.0, 0.0, 0.3));
+  EXPECT_TRUE(pyramid.isFree(0.0, 0.0, 0.25));
+  EXPECT_TRUE(pyramid.isFree(0.0, 0.0, 0.3, graceful_controller::LETHAL_COST));
+  costs[my * 100 + mx] = 100;
+  pyramid.update(grid);
+  EXPECT_TRUE(pyramid.isFree(0.0, 0.0, 0.3));
+
+  // Off the grid, or partly
+  EXPECT_FALSE(pyramid.isFree(2.4, 0.0, 0.3));
+  EXPECT_FALSE(pyramid.isFree(0.0, -2.3, 0.3));
+  EXPECT_FALSE(pyramid.isFree(-5.0, 0.0, 0.3));
+  EXPECT_TRUE(pyramid.isFree(2.1, 2.1, 0.3));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,254 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Accuracy harness for MathBackend::APPROXIMATE and MathBackend::LOOKUP_TABLE.
+ * Each test reports the worst case deviation from libm over a dense grid of
+ * inputs, and checks it against the bounds documented in fast_math.hpp and
+ * curvature_table.hpp.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include <graceful_controller/curvature_table.hpp>
+#include <graceful_controller/fast_math.hpp>
+#include <graceful_controller/graceful_controller.hpp>
+
+using graceful_controller::ControlLawParameters;
+using graceful_controller::CurvatureTable;
+using graceful_controller::ExactMath;
+using graceful_controller::FastMath;
+using graceful_controller::GracefulController;
+using graceful_controller::MathBackend;
+
+void report(const char* name, double worst, double bound)
+{
+  std::printf("[ ACCURACY ] %-32s worst %.3e (bound %.1e)\n", name, worst, bound);
+  testing::Test::RecordProperty(name, std::to_string(worst));
+  EXPECT_LT(worst, bound) << name;
+}
+
+TEST(FastMathTests, test_atan)
+{
+  double worst = 0.0;
+  for (double x = -100.0; x <= 100.0; x += 0.0001)
+  {
+    worst = std::max(worst, std::fabs(FastMath::atan(x) - ExactMath::atan(x)));
+  }
+  report("atan", worst, 2.5e-7);
+  EXPECT_EQ(FastMath::atan(HUGE_VAL), M_PI_2);
+  EXPECT_TRUE(std::isnan(FastMath::atan(NAN)));
+}
+
+TEST(FastMathTests, test_atan2)
+{
+  double worst = 0.0;
+  for (double x = -2.0; x <= 2.0; x += 0.001)
+  {
+    for (double y = -2.0; y <= 2.0; y += 0.003)
+    {
+      worst = std::max(worst, std::fabs(FastMath::atan2(y, x) - ExactMath::atan2(y, x)));
+    }
+  }
+  report("atan2", worst, 2.5e-7);
+
+  // Signed zeros select the branch, the control law depends on these
+  const double zeros[] = { 0.0, -0.0 };
+  const double values[] = { -1.0, 1.0, 0.0, -0.0 };
+  for (double zero : zeros)
+  {
+    for (double value : values)
+    {
+      EXPECT_EQ(FastMath::atan2(zero, value), ExactMath::atan2(zero, value));
+      EXPECT_EQ(std::signbit(FastMath::atan2(zero, value)), std::signbit(ExactMath::atan2(zero, value)));
+      EXPECT_EQ(FastMath::atan2(value, zero), ExactMath::atan2(value, zero));
+    }
+  }
+}
+
+TEST(FastMathTests, test_sin)
+{
+  double worst = 0.0;
+  for (double x = -M_PI; x <= M_PI; x += 0.00001)
+  {
+    worst = std::max(worst, std::fabs(FastMath::sin(x) - ExactMath::sin(x)));
+  }
+  report("sin", worst, 3.5e-9);
+  // Outside of the approximated range
+  EXPECT_EQ(FastMath::sin(4.0), ExactMath::sin(4.0));
+}
+
+TEST(FastMathTests, test_pow)
+{
+  // Error of the logarithm grows with the exponent
+  const double exponents[] = { 0.5, 1.0, 1.5, 1.7, 2.0, 3.0, 10.0 };
+  double worst_low = 0.0, worst_high = 0.0;
+  for (double y : exponents)
+  {
+    for (double x = 1e-6; x <= 1e4; x *= 1.0001)
+    {
+      double exact = ExactMath::pow(x, y);
+      double error = std::fabs(FastMath::pow(x, y) - exact) / exact;
+      if (y <= 2.0)
+      {
+        worst_low = std::max(worst_low, error);
+      }
+      worst_high = std::max(worst_high, error);
+    }
+  }
+  report("pow (relative, y <= 2)", worst_low, 5e-7);
+  report("pow (relative, y <= 10)", worst_high, 2.5e-6);
+
+  // Special values are passed through to std::pow
+  EXPECT_EQ(FastMath::pow(0.0, 2.0), 0.0);
+  EXPECT_EQ(FastMath::pow(0.0, 0.0), 1.0);
+  EXPECT_EQ(FastMath::pow(HUGE_VAL, 2.0), HUGE_VAL);
+  EXPECT_EQ(FastMath::pow(1e200, 2.0), HUGE_VAL);
+  EXPECT_EQ(FastMath::pow(1e-200, 2.0), 0.0);
+}
+
+void expectLawWithinBounds(double lambda, bool backward_motion, double bound)
+{
+  GracefulController exact(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, lambda, MathBackend::EXACT);
+  GracefulController fast(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, lambda, MathBackend::APPROXIMATE);
+
+  double worst_x = 0.0, worst_th = 0.0;
+  for (double x = -2.0; x <= 2.0; x += 0.02)
+  {
+    for (double y = -2.0; y <= 2.0; y += 0.02)
+    {
+      for (double theta = -3.1; theta <= 3.1; theta += 0.1)
+      {
+        // Skip the discontinuity, where either side is a valid answer
+        double delta = backward_motion ? std::atan2(-y, -x) : std::atan2(-y, x);
+        if (std::hypot(x, y) < 1e-6 || M_PI - std::fabs(std::remainder(theta + delta, 2.0 * M_PI)) < 1e-5)
+        {
+          continue;
+        }
+
+        double exact_x, exact_th, fast_x, fast_th;
+        exact.approach(x, y, theta, exact_x, exact_th, backward_motion);
+        fast.approach(x, y, theta, fast_x, fast_th, backward_motion);
+        worst_x = std::max(worst_x, std::fabs(exact_x - fast_x));
+        worst_th = std::max(worst_th, std::fabs(exact_th - fast_th));
+      }
+    }
+  }
+
+  char name[64];
+  std::snprintf(name, sizeof(name), "vel_x (lambda %.1f%s)", lambda, backward_motion ? ", backward" : "");
+  report(name, worst_x, bound);
+  std::snprintf(name, sizeof(name), "vel_th (lambda %.1f%s)", lambda, backward_motion ? ", backward" : "");
+  report(name, worst_th, bound);
+}
+
+TEST(FastMathTests, test_control_law)
+{
+  expectLawWithinBounds(2.0, false, 1e-5);
+  expectLawWithinBounds(2.0, true, 1e-5);
+  expectLawWithinBounds(1.7, false, 1e-5);
+}
+
+TEST(FastMathTests, test_curvature_table)
+{
+  ControlLawParameters params(2.0, 1.0, 0.5, 0.4, 2.0);
+  const double resolutions[] = { 0.02, 0.01 };
+  for (double resolution : resolutions)
+  {
+    CurvatureTable table(params, resolution);
+    double worst = 0.0;
+    for (double delta = -M_PI; delta <= M_PI; delta += 0.0013)
+    {
+      for (double theta2 = -M_PI; theta2 <= M_PI; theta2 += 0.0017)
+      {
+        double exact = CurvatureTable::curvatureNumerator(params, delta, theta2);
+        worst = std::max(worst, std::fabs(table.lookup(delta, theta2) - exact));
+      }
+    }
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "table (resolution %.2f)", resolution);
+    // The error measured at cell centers is the worst case, up to rounding
+    report(name, worst, 1.01 * table.getMaxError());
+    std::printf("[ ACCURACY ] %-32s %zu bytes\n", name, table.getSizeInBytes());
+  }
+
+  // Bilinear interpolation, halving the resolution quarters the error
+  CurvatureTable coarse(params, 0.02), fine(params, 0.01);
+  EXPECT_LT(fine.getMaxError(), 0.3 * coarse.getMaxError());
+
+  // Too fine a resolution is clamped, rather than allocating hundreds of MB
+  CurvatureTable clamped(params, 0.0001);
+  EXPECT_NEAR(clamped.getResolution(), CurvatureTable::MIN_RESOLUTION, 1e-5);
+  EXPECT_LT(clamped.getSizeInBytes(), 13000000u);
+}
+
+void expectTableWithinBounds(bool backward_motion, double bound)
+{
+  GracefulController exact(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, 2.0, MathBackend::EXACT);
+  GracefulController table(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, 2.0, MathBackend::LOOKUP_TABLE);
+
+  double worst_x = 0.0, worst_th = 0.0;
+  for (double r = 0.1; r <= 2.0; r += 0.05)
+  {
+    for (double angle = -M_PI; angle < M_PI; angle += 0.05)
+    {
+      for (double theta = -3.1; theta <= 3.1; theta += 0.1)
+      {
+        double x = r * std::cos(angle);
+        double y = r * std::sin(angle);
+        // Skip the discontinuity, where either side is a valid answer
+        double delta = backward_motion ? std::atan2(-y, -x) : std::atan2(-y, x);
+        if (M_PI - std::fabs(std::remainder(theta + delta, 2.0 * M_PI)) < 0.02)
+        {
+          continue;
+        }
+
+        double exact_x, exact_th, table_x, table_th;
+        exact.approach(x, y, theta, exact_x, exact_th, backward_motion);
+        table.approach(x, y, theta, table_x, table_th, backward_motion);
+        worst_x = std::max(worst_x, std::fabs(exact_x - table_x));
+        worst_th = std::max(worst_th, std::fabs(exact_th - table_th));
+      }
+    }
+  }
+
+  char name[64];
+  std::snprintf(name, sizeof(name), "table vel_x%s", backward_motion ? " (backward)" : "");
+  report(name, worst_x, bound);
+  std::snprintf(name, sizeof(name), "table vel_th%s", backward_motion ? " (backward)" : "");
+  report(name, worst_th, bound);
+}
+
+TEST(FastMathTests, test_lookup_table_law)
+{
+  expectTableWithinBounds(false, 1e-3);
+  expectTableWithinBounds(true, 1e-3);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
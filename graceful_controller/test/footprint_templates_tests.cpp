@@ -0,0 +1,257 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <graceful_controller/footprint_templates.hpp>
+
+using graceful_controller::CostGrid;
+using graceful_controller::FootprintTemplates;
+using graceful_controller::Point2D;
+
+// A rectangular robot, the same as in config.yaml of the ROS tests
+static std::vector<Point2D> rectangle()
+{
+  return { { 0.3, 0.2 }, { 0.3, -0.2 }, { -0.3, -0.2 }, { -0.3, 0.2 } };
+}
+
+// Footprint at a pose, scaled
+static std::vector<Point2D> transform(const std::vector<Point2D>& footprint, double x, double y, double yaw,
+                                      double scaling)
+{
+  std::vector<Point2D> result;
+  for (const Point2D& point : footprint)
+  {
+    double px = point.x * scaling;
+    double py = point.y * scaling;
+    result.push_back({ x + px * std::cos(yaw) - py * std::sin(yaw), y + px * std::sin(yaw) + py * std::cos(yaw) });
+  }
+  return result;
+}
+
+// Distance from a point to the boundary of a polygon
+static double boundaryDistance(const std::vector<Point2D>& polygon, double x, double y)
+{
+  double distance = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < polygon.size(); ++i)
+  {
+    const Point2D& a = polygon[i];
+    const Point2D& b = polygon[(i + 1) % polygon.size()];
+    double dx = b.x - a.x, dy = b.y - a.y;
+    double t = ((x - a.x) * dx + (y - a.y) * dy) / (dx * dx + dy * dy);
+    t = std::min(1.0, std::max(0.0, t));
+    distance = std::min(distance, std::hypot(a.x + t * dx - x, a.y + t * dy - y));
+  }
+  return distance;
+}
+
+class FootprintTemplatesTest : public ::testing::Test
+{
+protected:
+  FootprintTemplatesTest() : costs(100 * 100, 0)
+  {
+    grid.costs = costs.data();
+    grid.size_x = 100;
+    grid.size_y = 100;
+    grid.resolution = 0.05;
+    grid.origin_x = -2.5;
+    grid.origin_y = -2.5;
+  }
+
+  std::vector<unsigned char> costs;
+  CostGrid grid;
+};
+
+TEST_F(FootprintTemplatesTest, test_conservative)
+{
+  FootprintTemplates templates(rectangle(), 0.05, 64, 1.5, 0.1);
+  EXPECT_GE(templates.getMaxScaling(), 1.5);
+  EXPECT_GT(templates.getSizeInBytes(), 0u);
+
+  std::mt19937 random(42);
+  std::uniform_real_distribution<double> position(-1.0, 1.0);
+  std::uniform_real_distribution<double> heading(-M_PI, M_PI);
+  std::uniform_real_distribution<double> scale(1.0, 1.5);
+  size_t checked = 0;
+  for (int trial = 0; trial < 200; ++trial)
+  {
+    double x = position(random), y = position(random), yaw = heading(random), scaling = scale(random);
+    std::vector<Point2D> polygon = transform(rectangle(), x, y, yaw, scaling);
+    EXPECT_FALSE(templates.isColliding(grid, x, y, yaw, scaling));
+
+    // Every cell that the exact boundary crosses is checked
+    std::vector<bool> crossed(costs.size(), false);
+    for (size_t i = 0; i < polygon.size(); ++i)
+    {
+      const Point2D& a = polygon[i];
+      const Point2D& b = polygon[(i + 1) % polygon.size()];
+      for (int step = 0; step <= 10000; ++step)
+      {
+        unsigned int mx, my;
+        ASSERT_TRUE(grid.worldToMap(a.x + (b.x - a.x) * step / 10000.0, a.y + (b.y - a.y) * step / 10000.0, mx, my));
+        crossed[my * grid.size_x + mx] = true;
+      }
+    }
+    for (size_t cell = 0; cell < costs.size(); ++cell)
+    {
+      if (crossed[cell])
+      {
+        costs[cell] = graceful_controller::LETHAL_COST;
+        EXPECT_TRUE(templates.isColliding(grid, x, y, yaw, scaling)) << "cell " << cell << ", trial " << trial;
+        costs[cell] = 0;
+        ++checked;
+      }
+    }
+
+    // Obstacles everywhere but within 4 cells of the boundary, such as inside the footprint, are not
+    for (unsigned int my = 0; my < grid.size_y; ++my)
+    {
+      for (unsigned int mx = 0; mx < grid.size_x; ++mx)
+      {
+        double cx = grid.origin_x + (mx + 0.5) * grid.resolution;
+        double cy = grid.origin_y + (my + 0.5) * grid.resolution;
+        if (boundaryDistance(polygon, cx, cy) > 4 * grid.resolution)
+        {
+          costs[my * grid.size_x + mx] = graceful_controller::LETHAL_COST;
+        }
+      }
+    }
+    EXPECT_FALSE(templates.isColliding(grid, x, y, yaw, scaling)) << "trial " << trial;
+    std::fill(costs.begin(), costs.end(), 0);
+  }
+  EXPECT_GT(checked, 1000u);
+}
+
+TEST_F(FootprintTemplatesTest, test_threshold_and_bounds)
+{
+  FootprintTemplates templates(rectangle(), 0.05, 16, 1.0, 0.0);
+  EXPECT_EQ(1.0, templates.getMaxScaling());
+
+  // Inscribed cost only collides with a lower threshold
+  unsigned int mx, my;
+  ASSERT_TRUE(grid.worldToMap(0.3, 0.0, mx, my));
+  costs[my * grid.size_x + mx] = graceful_controller::INSCRIBED_COST;
+  EXPECT_FALSE(templates.isColliding(grid, 0.0, 0.0, 0.0, 1.0));
+  EXPECT_TRUE(templates.isColliding(grid, 0.0, 0.0, 0.0, 1.0, graceful_controller::INSCRIBED_COST));
+
+  // Off the grid, or partly
+  EXPECT_TRUE(templates.isColliding(grid, 5.0, 0.0, 0.0, 1.0));
+  EXPECT_TRUE(templates.isColliding(grid, 2.4, 0.0, 0.0, 1.0));
+  EXPECT_FALSE(templates.isColliding(grid, 2.0, 0.0, 0.0, 1.0));
+
+  // Headings wrap around
+  size_t count_a, count_b;
+  const graceful_controller::FootprintSpan* a = templates.getSpans(M_PI - 1e-6, 1.0, count_a);
+  const graceful_controller::FootprintSpan* b = templates.getSpans(-M_PI - 1e-6, 1.0, count_b);
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(count_a, count_b);
+}
+
+TEST(CostGridTests, test_max_cost)
+{
+  // Every length, with the highest cost in every place, including the tail
+  // that the vectorized scan reads twice
+  std::vector<unsigned char> costs(100);
+  for (size_t count = 0; count <= 40; ++count)
+  {
+    for (size_t i = 0; i < costs.size(); ++i)
+    {
+      costs[i] = i % 7;
+    }
+    unsigned char expected = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+      expected = std::max(expected, costs[3 + i]);
+    }
+    EXPECT_EQ(expected, graceful_controller::getMaxCost(&costs[3], count));
+    for (size_t place = 0; place < count; ++place)
+    {
+      costs[3 + place] = graceful_controller::LETHAL_COST;
+      EXPECT_EQ(graceful_controller::LETHAL_COST, graceful_controller::getMaxCost(&costs[3], count));
+      costs[3 + place] = (3 + place) % 7;
+    }
+
+    // Cells around the span are not read
+    costs[2] = costs[3 + count] = graceful_controller::NO_INFORMATION_COST;
+    EXPECT_EQ(expected, graceful_controller::getMaxCost(&costs[3], count));
+  }
+}
+
+TEST_F(FootprintTemplatesTest, test_filled)
+{
+  FootprintTemplates boundary(rectangle(), 0.05, 64, 1.5, 0.1);
+  FootprintTemplates filled(rectangle(), 0.05, 64, 1.5, 0.1, true);
+  EXPECT_FALSE(boundary.isFilled());
+  EXPECT_TRUE(filled.isFilled());
+
+  // An obstacle in the middle of the footprint is only caught when filled
+  unsigned int mx, my;
+  ASSERT_TRUE(grid.worldToMap(0.0, 0.0, mx, my));
+  costs[my * grid.size_x + mx] = graceful_controller::LETHAL_COST;
+  EXPECT_FALSE(boundary.isColliding(grid, 0.01, 0.01, 0.3, 1.0));
+  EXPECT_TRUE(filled.isColliding(grid, 0.01, 0.01, 0.3, 1.0));
+  costs[my * grid.size_x + mx] = 0;
+
+  // Every cell whose center is inside the footprint is checked, and cells well outside are not
+  std::mt19937 random(42);
+  std::uniform_real_distribution<double> position(-1.0, 1.0);
+  std::uniform_real_distribution<double> heading(-M_PI, M_PI);
+  std::uniform_real_distribution<double> scale(1.0, 1.5);
+  for (int trial = 0; trial < 50; ++trial)
+  {
+    double x = position(random), y = position(random), yaw = heading(random), scaling = scale(random);
+    std::vector<Point2D> polygon = transform(rectangle(), x, y, yaw, scaling);
+    for (unsigned int cy = 0; cy < grid.size_y; ++cy)
+    {
+      for (unsigned int cx = 0; cx < grid.size_x; ++cx)
+      {
+        // Inside the rectangle if on the inner side of every edge
+        double px = grid.origin_x + (cx + 0.5) * grid.resolution;
+        double py = grid.origin_y + (cy + 0.5) * grid.resolution;
+        bool inside = true;
+        for (size_t i = 0; i < polygon.size(); ++i)
+        {
+          const Point2D& a = polygon[i];
+          const Point2D& b = polygon[(i + 1) % polygon.size()];
+          inside &= (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x) <= 0.0;
+        }
+        double distance = boundaryDistance(polygon, px, py);
+        if (!inside && distance <= 4 * grid.resolution)
+        {
+          continue;
+        }
+        costs[cy * grid.size_x + cx] = graceful_controller::LETHAL_COST;
+        EXPECT_EQ(inside, filled.isColliding(grid, x, y, yaw, scaling)) << "trial " << trial;
+        costs[cy * grid.size_x + cx] = 0;
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,827 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmarks of the core library. Besides the console output, results can
+ * be written as JSON for tracking across releases:
+ *   graceful_controller_bench --benchmark_out=bench.json --benchmark_out_format=json
+ * The run_graceful_controller_bench target does this. Each benchmark reports
+ * time_per_call (or time_per_step for rollouts), in seconds in the JSON.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <graceful_controller/cost_pyramid.hpp>
+#include <graceful_controller/footprint_templates.hpp>
+#include <graceful_controller/graceful_controller.hpp>
+#include <graceful_controller/graceful_rollout.hpp>
+#include <graceful_controller/occupancy_integral.hpp>
+#include <graceful_controller/rollout_cache.hpp>
+#include <graceful_controller/thread_pool.hpp>
+
+using graceful_controller::ControlLawParameters;
+using graceful_controller::CostGrid;
+using graceful_controller::CostPyramid;
+using graceful_controller::ExactMath;
+using graceful_controller::FootprintTemplates;
+using graceful_controller::GracefulController;
+using graceful_controller::GracefulControllerConstPtr;
+using graceful_controller::GracefulRollout;
+using graceful_controller::MathBackend;
+using graceful_controller::OccupancyIntegral;
+using graceful_controller::Point2D;
+using graceful_controller::Pose2D;
+using graceful_controller::RolloutCache;
+using graceful_controller::RolloutIntegrator;
+using graceful_controller::RolloutParameters;
+using graceful_controller::TrajectoryBuffer;
+using graceful_controller::VelocityLimits;
+
+// Default parameters of the ROS wrapper
+const double K1 = 2.0;
+const double K2 = 1.0;
+const double MIN_VEL = 0.1;
+const double MAX_VEL = 0.5;
+const double MAX_DECEL = 2.5;
+const double MAX_VEL_THETA = 1.0;
+const double BETA = 0.4;
+const double LAMBDA = 2.0;
+
+// Costmap resolution, which sets the simulation step size
+const double RESOLUTION = 0.025;
+
+/**
+ * @brief Forward simulate the control law towards a target, in the same
+ *        way as GracefulControllerROS::simulate() (without collision checks).
+ * @returns Number of control law evaluations.
+ */
+template <typename Approach>
+size_t rollout(Approach approach, double target_x, double target_y, double target_theta)
+{
+  double x = 0.0, y = 0.0, yaw = 0.0;
+  size_t steps = 0;
+  while (steps < 1000)
+  {
+    // Error between the simulated pose and the target
+    double dx = target_x - x;
+    double dy = target_y - y;
+    double error_x = dx * std::cos(yaw) + dy * std::sin(yaw);
+    double error_y = dy * std::cos(yaw) - dx * std::sin(yaw);
+    if (steps > 0 && std::hypot(error_x, error_y) < RESOLUTION)
+    {
+      break;
+    }
+
+    double vel_x, vel_th;
+    approach(error_x, error_y, target_theta - yaw, vel_x, vel_th);
+    ++steps;
+
+    double dt = (vel_x > 0.0) ? RESOLUTION / vel_x : 0.1;
+    x += dt * vel_x * std::cos(yaw);
+    y += dt * vel_x * std::sin(yaw);
+    yaw += dt * vel_th;
+  }
+  return steps;
+}
+
+/**
+ * @brief Distributions of targets, in polar form relative to the robot.
+ */
+enum Distribution
+{
+  LOOKAHEAD,  // Typical targets: r within a 1m lookahead, ahead of the robot
+  WIDE,       // Anywhere in the local window, any heading
+  NEAR_ZERO   // Pathological r close to zero, where the curvature blows up
+};
+
+const char* distributionName(int distribution)
+{
+  switch (distribution)
+  {
+    case LOOKAHEAD:
+      return "lookahead";
+    case WIDE:
+      return "wide";
+    default:
+      return "near_zero";
+  }
+}
+
+/**
+ * @brief Targets in structure-of-arrays form.
+ */
+struct Targets
+{
+  Targets(int distribution, size_t count = 1024)
+  {
+    // Fixed seed, so that every run sees the same targets
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> r, delta, theta;
+    switch (distribution)
+    {
+      case LOOKAHEAD:
+        r = std::uniform_real_distribution<double>(0.2, 1.0);
+        delta = std::uniform_real_distribution<double>(-1.0, 1.0);
+        theta = std::uniform_real_distribution<double>(-0.5, 0.5);
+        break;
+      case WIDE:
+        r = std::uniform_real_distribution<double>(0.05, 2.0);
+        delta = std::uniform_real_distribution<double>(-M_PI, M_PI);
+        theta = std::uniform_real_distribution<double>(-M_PI, M_PI);
+        break;
+      default:
+        r = std::uniform_real_distribution<double>(1e-9, 1e-4);
+        delta = std::uniform_real_distribution<double>(-M_PI, M_PI);
+        theta = std::uniform_real_distribution<double>(-M_PI, M_PI);
+        break;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+      // delta is the bearing of the robot as seen from the target,
+      // so the target is at bearing -delta from the robot
+      double target_r = r(rng);
+      double target_delta = delta(rng);
+      x.push_back(target_r * std::cos(-target_delta));
+      y.push_back(target_r * std::sin(-target_delta));
+      this->theta.push_back(theta(rng));
+    }
+  }
+
+  size_t size() const
+  {
+    return x.size();
+  }
+
+  std::vector<double> x, y, theta;
+};
+
+/**
+ * @brief Report time per call of something done calls times per iteration.
+ */
+void reportPerCall(benchmark::State& state, size_t calls)
+{
+  state.SetItemsProcessed(state.iterations() * calls);
+  state.counters["time_per_call"] = benchmark::Counter(calls, benchmark::Counter::kIsIterationInvariantRate |
+                                                              benchmark::Counter::kInvert);
+}
+
+GracefulController makeController(MathBackend math_backend = MathBackend::EXACT)
+{
+  return GracefulController(K1, K2, MIN_VEL, MAX_VEL, MAX_DECEL, MAX_VEL_THETA, BETA, LAMBDA, math_backend);
+}
+
+// Arguments of the approach benchmarks: distribution, backward motion
+void approachArguments(benchmark::internal::Benchmark* benchmark)
+{
+  benchmark->ArgNames({ "distribution", "backward" });
+  for (int distribution : { LOOKAHEAD, WIDE, NEAR_ZERO })
+  {
+    for (int backward : { 0, 1 })
+    {
+      benchmark->Args({ distribution, backward });
+    }
+  }
+}
+
+// Scalar control law, through the out-of-line GracefulController::approach()
+static void BM_Approach(benchmark::State& state, MathBackend math_backend)
+{
+  GracefulController controller = makeController(math_backend);
+  Targets targets(state.range(0));
+  bool backward = state.range(1);
+  state.SetLabel(distributionName(state.range(0)));
+  for (auto _ : state)
+  {
+    for (size_t i = 0; i < targets.size(); ++i)
+    {
+      double vel_x, vel_th;
+      controller.approach(targets.x[i], targets.y[i], targets.theta[i], vel_x, vel_th, backward);
+      benchmark::DoNotOptimize(vel_x);
+      benchmark::DoNotOptimize(vel_th);
+    }
+  }
+  reportPerCall(state, targets.size());
+}
+BENCHMARK_CAPTURE(BM_Approach, exact, MathBackend::EXACT)->Apply(approachArguments);
+BENCHMARK_CAPTURE(BM_Approach, approximate, MathBackend::APPROXIMATE)->Apply(approachArguments);
+BENCHMARK_CAPTURE(BM_Approach, lookup_table, MathBackend::LOOKUP_TABLE)->Apply(approachArguments);
+
+// Scalar control law, inlined approachKernel()
+static void BM_ApproachKernel(benchmark::State& state)
+{
+  ControlLawParameters params(K1, K2, MAX_DECEL, BETA, LAMBDA);
+  VelocityLimits limits = { MIN_VEL, MAX_VEL, MAX_VEL_THETA };
+  Targets targets(state.range(0));
+  bool backward = state.range(1);
+  state.SetLabel(distributionName(state.range(0)));
+  for (auto _ : state)
+  {
+    for (size_t i = 0; i < targets.size(); ++i)
+    {
+      double vel_x, vel_th;
+      graceful_controller::approachKernel<ExactMath>(params, limits, targets.x[i], targets.y[i], targets.theta[i],
+                                                     vel_x, vel_th, backward);
+      benchmark::DoNotOptimize(vel_x);
+      benchmark::DoNotOptimize(vel_th);
+    }
+  }
+  reportPerCall(state, targets.size());
+}
+BENCHMARK(BM_ApproachKernel)->Apply(approachArguments);
+
+// Vectorized control law, with the batch size as third argument
+static void BM_ApproachBatch(benchmark::State& state)
+{
+  GracefulController controller = makeController();
+  Targets targets(state.range(0), state.range(2));
+  bool backward = state.range(1);
+  std::vector<double> vel_x(targets.size()), vel_th(targets.size());
+  state.SetLabel(distributionName(state.range(0)));
+  for (auto _ : state)
+  {
+    controller.approachBatch(targets.x.data(), targets.y.data(), targets.theta.data(),
+                             vel_x.data(), vel_th.data(), targets.size(), backward);
+    benchmark::DoNotOptimize(vel_x.data());
+    benchmark::DoNotOptimize(vel_th.data());
+    benchmark::ClobberMemory();
+  }
+  reportPerCall(state, targets.size());
+}
+BENCHMARK(BM_ApproachBatch)->Apply([](benchmark::internal::Benchmark* benchmark)
+{
+  benchmark->ArgNames({ "distribution", "backward", "count" });
+  for (int distribution : { LOOKAHEAD, WIDE, NEAR_ZERO })
+  {
+    for (int backward : { 0, 1 })
+    {
+      benchmark->Args({ distribution, backward, 1024 });
+    }
+  }
+  // Small batches, where the scalar remainder matters
+  for (int count : { 3, 8, 13, 64 })
+  {
+    benchmark->Args({ LOOKAHEAD, 0, count });
+  }
+});
+
+// Full rollout, stepping through the out-of-line GracefulController::approach()
+static void BM_RolloutWrapper(benchmark::State& state)
+{
+  GracefulController controller = makeController();
+  auto approach = [&controller](double x, double y, double theta, double& vel_x, double& vel_th)
+  {
+    controller.approach(x, y, theta, vel_x, vel_th);
+  };
+  size_t steps = 0;
+  for (auto _ : state)
+  {
+    steps += rollout(approach, 1.0, 0.3, 0.5);
+  }
+  state.counters["time_per_step"] =
+      benchmark::Counter(steps, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+BENCHMARK(BM_RolloutWrapper);
+
+// Full rollout, stepping through the inlined approachKernel()
+static void BM_RolloutKernel(benchmark::State& state)
+{
+  ControlLawParameters params(K1, K2, MAX_DECEL, BETA, LAMBDA);
+  VelocityLimits limits = { MIN_VEL, MAX_VEL, MAX_VEL_THETA };
+  auto approach = [&params, &limits](double x, double y, double theta, double& vel_x, double& vel_th)
+  {
+    graceful_controller::approachKernel<ExactMath>(params, limits, x, y, theta, vel_x, vel_th);
+  };
+  size_t steps = 0;
+  for (auto _ : state)
+  {
+    steps += rollout(approach, 1.0, 0.3, 0.5);
+  }
+  state.counters["time_per_step"] =
+      benchmark::Counter(steps, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+BENCHMARK(BM_RolloutKernel);
+
+// GracefulRollout in free space, for each integrator and heading representation
+static void BM_GracefulRollout(benchmark::State& state, RolloutIntegrator integrator, bool incremental_rotation)
+{
+  GracefulControllerConstPtr controller = std::make_shared<const GracefulController>(makeController());
+  RolloutParameters params;
+  params.resolution = RESOLUTION;
+  params.integrator = integrator;
+  params.incremental_rotation = incremental_rotation;
+  params.footprint_radius = 0.3;
+  GracefulRollout rollout(controller, params);
+  graceful_controller::CollisionChecker free_space = [](const Pose2D&, double)
+  {
+    return false;
+  };
+
+  std::vector<Pose2D> storage(2000);
+  Pose2D target = { 1.0, 0.3, 0.5 };
+  VelocityLimits limits = { MIN_VEL, MAX_VEL, MAX_VEL_THETA };
+  size_t poses = 0;
+  for (auto _ : state)
+  {
+    TrajectoryBuffer trajectory(storage.data(), storage.size());
+    benchmark::DoNotOptimize(rollout.simulate(target, limits, false, free_space, trajectory));
+    poses += trajectory.size;
+  }
+  state.counters["time_per_step"] =
+      benchmark::Counter(poses, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+BENCHMARK_CAPTURE(BM_GracefulRollout, euler, RolloutIntegrator::EULER, false);
+BENCHMARK_CAPTURE(BM_GracefulRollout, arc, RolloutIntegrator::ARC, false);
+BENCHMARK_CAPTURE(BM_GracefulRollout, euler_incremental, RolloutIntegrator::EULER, true);
+BENCHMARK_CAPTURE(BM_GracefulRollout, arc_incremental, RolloutIntegrator::ARC, true);
+
+// A target that only the slowest of several velocity caps reaches: the footprint,
+// scaled with velocity, collides in a narrow aisle halfway to the target.
+// Caps are either simulated one after another (0), in lockstep (1) or bisected (2),
+// with the second argument as the spacing of the caps in mm/s.
+static void BM_VelocityCaps(benchmark::State& state)
+{
+  GracefulControllerConstPtr controller = std::make_shared<const GracefulController>(makeController());
+  RolloutParameters params;
+  params.resolution = RESOLUTION;
+  params.max_vel_x = MAX_VEL;
+  params.scaling_vel_x = 0.25;
+  params.scaling_factor = 0.5;
+  GracefulRollout rollout(controller, params);
+  graceful_controller::CollisionChecker aisle = [](const Pose2D& pose, double footprint_scaling)
+  {
+    return pose.x > 0.5 && footprint_scaling > 1.0;
+  };
+
+  std::vector<double> caps;
+  for (double cap = MAX_VEL; cap >= 0.25 - 1e-9; cap -= state.range(1) / 1000.0)
+  {
+    caps.push_back(cap);
+  }
+  std::vector<std::vector<Pose2D>> storage(caps.size(), std::vector<Pose2D>(2000));
+  std::vector<TrajectoryBuffer> trajectories;
+  for (std::vector<Pose2D>& poses : storage)
+  {
+    trajectories.emplace_back(poses.data(), poses.size());
+  }
+  std::vector<graceful_controller::RolloutResult> results(caps.size());
+
+  Pose2D target = { 1.0, 0.3, 0.5 };
+  VelocityLimits limits = { MIN_VEL, MAX_VEL, MAX_VEL_THETA };
+  int mode = state.range(0);
+  state.SetLabel(mode == 1 ? "lockstep" : (mode == 2 ? "bisection" : "sequential"));
+  std::function<bool(size_t)> reaches = [&](size_t i)
+  {
+    limits.max_abs_velocity = caps[i];
+    results[i] = rollout.simulate(target, limits, false, aisle, trajectories[i]);
+    return results[i].status == graceful_controller::RolloutStatus::SUCCESS;
+  };
+  for (auto _ : state)
+  {
+    if (mode == 2)
+    {
+      benchmark::DoNotOptimize(graceful_controller::bisectCaps(caps.size(), 0, reaches));
+    }
+    else if (mode == 1)
+    {
+      benchmark::DoNotOptimize(rollout.simulateCaps(target, limits, caps.data(), caps.size(), false, aisle,
+                                                    trajectories.data(), results.data()));
+    }
+    else
+    {
+      for (size_t i = 0; i < caps.size(); ++i)
+      {
+        limits.max_abs_velocity = caps[i];
+        results[i] = rollout.simulate(target, limits, false, aisle, trajectories[i]);
+        if (results[i].status == graceful_controller::RolloutStatus::SUCCESS)
+        {
+          break;
+        }
+      }
+    }
+  }
+  state.counters["caps"] = caps.size();
+}
+BENCHMARK(BM_VelocityCaps)->ArgNames({ "mode", "step" })->Args({ 0, 50 })->Args({ 1, 50 })->Args({ 2, 50 })
+    ->Args({ 0, 10 })->Args({ 1, 10 })->Args({ 2, 10 });
+
+// A rollout towards a target 2m ahead, collision checked step by step (0) or
+// lazily (1). The checker tests 32 points of a circular footprint of 0.3m
+// against a post, either halfway along the path or out of the way.
+static void BM_LazyCollision(benchmark::State& state)
+{
+  GracefulControllerConstPtr controller = std::make_shared<const GracefulController>(makeController());
+  RolloutParameters params;
+  params.resolution = RESOLUTION;
+  params.lazy_collision_checking = state.range(0);
+  GracefulRollout rollout(controller, params);
+  double post_x = state.range(1) ? 1.0 : 10.0;
+  graceful_controller::CollisionChecker footprint = [post_x](const Pose2D& pose, double footprint_scaling)
+  {
+    bool colliding = false;
+    for (int i = 0; i < 32; ++i)
+    {
+      double angle = 2.0 * M_PI * i / 32;
+      double x = pose.x + 0.3 * footprint_scaling * std::cos(angle);
+      double y = pose.y + 0.3 * footprint_scaling * std::sin(angle);
+      colliding |= std::hypot(x - post_x, y) < 0.05;
+    }
+    return colliding;
+  };
+
+  std::vector<Pose2D> poses(2000);
+  std::vector<double> scalings(poses.size());
+  TrajectoryBuffer trajectory(poses.data(), poses.size(), scalings.data());
+  Pose2D target = { 2.0, 0.0, 0.0 };
+  VelocityLimits limits = { MIN_VEL, MAX_VEL, MAX_VEL_THETA };
+  state.SetLabel(std::string(params.lazy_collision_checking ? "lazy" : "eager") +
+                 (state.range(1) ? ", blocked" : ", free"));
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(rollout.simulate(target, limits, false, footprint, trajectory));
+  }
+}
+BENCHMARK(BM_LazyCollision)->ArgNames({ "lazy", "blocked" })->Args({ 0, 1 })->Args({ 1, 1 })->Args({ 0, 0 })
+    ->Args({ 1, 0 });
+
+// The same target every cycle, through the rollout cache. Every cycle is a new
+// generation, so hits (1) still replay the collision checks, misses (0) simulate.
+static void BM_RolloutCache(benchmark::State& state)
+{
+  GracefulControllerConstPtr controller = std::make_shared<const GracefulController>(makeController());
+  RolloutParameters params;
+  params.resolution = RESOLUTION;
+  GracefulRollout rollout(controller, params);
+  graceful_controller::CollisionChecker free_space = [](const Pose2D& pose, double)
+  {
+    return pose.y > 2.0;
+  };
+  RolloutCache cache(16, 2000, 2000, 0.01);
+
+  std::vector<Pose2D> storage(2000);
+  Pose2D target = { 1.0, 0.3, 0.5 };
+  VelocityLimits limits = { MIN_VEL, MAX_VEL, MAX_VEL_THETA };
+  bool hit = state.range(0);
+  state.SetLabel(hit ? "hit" : "miss");
+  uint64_t generation = 0;
+  for (auto _ : state)
+  {
+    if (!hit)
+    {
+      cache.clear();
+    }
+    TrajectoryBuffer trajectory(storage.data(), storage.size());
+    benchmark::DoNotOptimize(cache.simulate(rollout, target, limits, false, free_space, ++generation, trajectory));
+  }
+}
+BENCHMARK(BM_RolloutCache)->ArgName("hit")->Arg(0)->Arg(1);
+
+// Worst case of the target search: a wall blocks all but the closest of 20
+// targets, so every one of them is simulated. Either in order on the calling
+// thread (0 workers) or spread over a thread pool.
+static void BM_TargetSearch(benchmark::State& state)
+{
+  GracefulControllerConstPtr controller = std::make_shared<const GracefulController>(makeController());
+  RolloutParameters params;
+  params.resolution = RESOLUTION;
+  GracefulRollout rollout(controller, params);
+  graceful_controller::CollisionChecker wall = [](const Pose2D& pose, double)
+  {
+    return pose.x > 0.45 && std::fabs(pose.y) < 1.0;
+  };
+
+  std::vector<Pose2D> targets;
+  for (int i = 19; i >= 0; --i)
+  {
+    targets.push_back({ 0.4 + 0.05 * i, 0.1, 0.0 });
+  }
+  size_t workers = state.range(0);
+  std::vector<std::vector<Pose2D>> storage(std::max<size_t>(workers, 1), std::vector<Pose2D>(2000));
+  graceful_controller::ThreadPool pool(workers);
+  VelocityLimits limits = { MIN_VEL, MAX_VEL, MAX_VEL_THETA };
+
+  auto evaluate = [&](size_t candidate, size_t worker, const std::atomic<size_t>& first)
+  {
+    graceful_controller::CollisionChecker cancellable = [&](const Pose2D& pose, double footprint_scaling)
+    {
+      return first.load(std::memory_order_relaxed) < candidate || wall(pose, footprint_scaling);
+    };
+    TrajectoryBuffer trajectory(storage[worker].data(), storage[worker].size());
+    return rollout.simulate(targets[candidate], limits, false, cancellable, trajectory).status ==
+           graceful_controller::RolloutStatus::SUCCESS;
+  };
+  std::atomic<size_t> no_bound(targets.size());
+  for (auto _ : state)
+  {
+    size_t first = targets.size();
+    if (workers > 0)
+    {
+      first = graceful_controller::findFirstSuccess(pool, targets.size(), evaluate);
+    }
+    else
+    {
+      for (size_t i = 0; i < targets.size() && first == targets.size(); ++i)
+      {
+        if (evaluate(i, 0, no_bound))
+        {
+          first = i;
+        }
+      }
+    }
+    benchmark::DoNotOptimize(first);
+  }
+}
+BENCHMARK(BM_TargetSearch)->ArgName("workers")->Arg(0)->Arg(2)->Arg(4)->UseRealTime();
+
+// The same wall in front of a dense path, 80 targets 1cm apart of which only the
+// closest few are reachable. Targets are tried in order (0) or by galloping (1).
+// Without the wall (second argument 0) the farthest target is reachable, as is
+// usual while following a path, and both take a single rollout.
+static void BM_TargetGallop(benchmark::State& state)
+{
+  GracefulControllerConstPtr controller = std::make_shared<const GracefulController>(makeController());
+  RolloutParameters params;
+  params.resolution = RESOLUTION;
+  GracefulRollout rollout(controller, params);
+  bool blocked = state.range(1);
+  graceful_controller::CollisionChecker wall = [blocked](const Pose2D& pose, double)
+  {
+    return blocked && pose.x > 0.45 && std::fabs(pose.y) < 1.0;
+  };
+
+  std::vector<Pose2D> targets;
+  for (int i = 79; i >= 0; --i)
+  {
+    targets.push_back({ 0.4 + 0.01 * i, 0.1, 0.0 });
+  }
+  std::vector<Pose2D> storage(2000);
+  TrajectoryBuffer trajectory(storage.data(), storage.size());
+  VelocityLimits limits = { MIN_VEL, MAX_VEL, MAX_VEL_THETA };
+
+  size_t rollouts = 0;
+  std::function<bool(size_t)> reaches = [&](size_t i)
+  {
+    ++rollouts;
+    return rollout.simulate(targets[i], limits, false, wall, trajectory).status ==
+           graceful_controller::RolloutStatus::SUCCESS;
+  };
+  bool galloping = state.range(0);
+  state.SetLabel(galloping ? "galloping" : "linear");
+  std::vector<char> outcomes;
+  for (auto _ : state)
+  {
+    rollouts = 0;
+    size_t first = targets.size();
+    if (galloping)
+    {
+      bool monotone;
+      first = graceful_controller::gallopSearch(targets.size(), 0, reaches, outcomes, monotone);
+    }
+    else
+    {
+      for (size_t i = 0; i < targets.size() && first == targets.size(); ++i)
+      {
+        if (reaches(i))
+        {
+          first = i;
+        }
+      }
+    }
+    benchmark::DoNotOptimize(first);
+  }
+  state.counters["rollouts"] = rollouts;
+  if (!blocked && rollouts != 1)
+  {
+    state.SkipWithError("the farthest target should take a single rollout");
+  }
+}
+BENCHMARK(BM_TargetGallop)->ArgNames({ "galloping", "wall" })->Args({ 0, 1 })->Args({ 1, 1 })->Args({ 0, 0 })
+    ->Args({ 1, 0 });
+
+// Footprint check in the way of costmap_2d::Costmap2DROS::footprintCost():
+// transform the vertices, then walk each edge from cell to cell
+static bool polygonColliding(const CostGrid& grid, const std::vector<Point2D>& footprint, double x, double y,
+                             double yaw)
+{
+  std::vector<int> cells_x(footprint.size()), cells_y(footprint.size());
+  for (size_t i = 0; i < footprint.size(); ++i)
+  {
+    double px = x + footprint[i].x * std::cos(yaw) - footprint[i].y * std::sin(yaw);
+    double py = y + footprint[i].x * std::sin(yaw) + footprint[i].y * std::cos(yaw);
+    unsigned int mx, my;
+    if (!grid.worldToMap(px, py, mx, my))
+    {
+      return true;
+    }
+    cells_x[i] = mx;
+    cells_y[i] = my;
+  }
+  for (size_t i = 0; i < footprint.size(); ++i)
+  {
+    size_t j = (i + 1) % footprint.size();
+    int x0 = cells_x[i], y0 = cells_y[i], x1 = cells_x[j], y1 = cells_y[j];
+    int dx = std::abs(x1 - x0), dy = -std::abs(y1 - y0);
+    int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+    int error = dx + dy;
+    while (true)
+    {
+      if (grid.getCost(x0, y0) >= graceful_controller::LETHAL_COST)
+      {
+        return true;
+      }
+      if (x0 == x1 && y0 == y1)
+      {
+        break;
+      }
+      int e2 = 2 * error;
+      if (e2 >= dy)
+      {
+        error += dy;
+        x0 += sx;
+      }
+      if (e2 <= dx)
+      {
+        error += dx;
+        y0 += sy;
+      }
+    }
+  }
+  return false;
+}
+
+// Collision checks of a footprint at random poses of a free 5cm costmap,
+// walking its polygon (0), looking up its boundary (1) or filled (2)
+// templates, or counting the cells of the rectangles covering them in a
+// summed area table (3), with the given number of yaw bins. The footprint is a 0.6m x 0.4m rectangle, or a round
+// one of 16 vertices and 0.3m radius.
+static void BM_FootprintCheck(benchmark::State& state)
+{
+  std::vector<Point2D> footprint = { { 0.3, 0.2 }, { -0.3, 0.2 }, { -0.3, -0.2 }, { 0.3, -0.2 } };
+  if (state.range(2) > 4)
+  {
+    footprint.clear();
+    for (int i = 0; i < state.range(2); ++i)
+    {
+      double angle = 2.0 * M_PI * i / state.range(2);
+      footprint.push_back({ 0.3 * std::cos(angle), 0.3 * std::sin(angle) });
+    }
+  }
+  std::vector<unsigned char> costs(200 * 200, graceful_controller::FREE_SPACE_COST);
+  CostGrid grid = { costs.data(), 200, 200, 0.05, 0.0, 0.0 };
+  FootprintTemplates templates(footprint, grid.resolution, state.range(1), 1.0, 0.0, state.range(0) >= 2);
+  OccupancyIntegral integral;
+  integral.update(grid);
+
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> position(2.0, 8.0), yaw(-M_PI, M_PI);
+  std::vector<Pose2D> poses(1024);
+  for (Pose2D& pose : poses)
+  {
+    pose = { position(rng), position(rng), yaw(rng) };
+  }
+
+  size_t i = 0;
+  for (auto _ : state)
+  {
+    const Pose2D& pose = poses[i++ % poses.size()];
+    if (state.range(0) == 3)
+    {
+      benchmark::DoNotOptimize(integral.isColliding(templates, pose.x, pose.y, pose.theta, 1.0));
+    }
+    else if (state.range(0))
+    {
+      benchmark::DoNotOptimize(templates.isColliding(grid, pose.x, pose.y, pose.theta, 1.0));
+    }
+    else
+    {
+      benchmark::DoNotOptimize(polygonColliding(grid, footprint, pose.x, pose.y, pose.theta));
+    }
+  }
+  state.counters["template_kb"] = templates.getSizeInBytes() / 1024.0;
+}
+BENCHMARK(BM_FootprintCheck)->ArgNames({ "templates", "yaw_bins", "vertices" })->Args({ 0, 1, 4 })
+    ->Args({ 1, 16, 4 })->Args({ 1, 64, 4 })->Args({ 1, 256, 4 })->Args({ 2, 64, 4 })->Args({ 3, 64, 4 })
+    ->Args({ 0, 1, 16 })->Args({ 1, 64, 16 })->Args({ 2, 64, 16 })->Args({ 3, 64, 16 });
+
+// Update of the summed area table of a 20m, 5cm costmap after an obstacle
+// cell toggles, either near the origin, which changes most of the table, or
+// near the far corner
+static void BM_OccupancyIntegral(benchmark::State& state)
+{
+  std::vector<unsigned char> costs(400 * 400, graceful_controller::FREE_SPACE_COST);
+  CostGrid grid = { costs.data(), 400, 400, 0.05, 0.0, 0.0 };
+  OccupancyIntegral integral;
+  integral.update(grid);
+  size_t cell = state.range(0) ? 390 * 400 + 390 : 10 * 400 + 10;
+  for (auto _ : state)
+  {
+    costs[cell] ^= graceful_controller::LETHAL_COST;
+    benchmark::DoNotOptimize(integral.update(grid));
+  }
+}
+BENCHMARK(BM_OccupancyIntegral)->ArgName("far_corner")->Arg(0)->Arg(1);
+
+// Collision checks of the 0.6m x 0.4m footprint at random poses of a 5cm
+// costmap with 20 scattered obstacles, inflated by 0.5m, walking its polygon
+// every time (0) or only when the max cost pyramid does not find the
+// circumscribed square of the footprint free (1)
+static void BM_FreeSpaceCheck(benchmark::State& state)
+{
+  std::vector<Point2D> footprint = { { 0.3, 0.2 }, { -0.3, 0.2 }, { -0.3, -0.2 }, { 0.3, -0.2 } };
+  std::vector<unsigned char> costs(200 * 200, graceful_controller::FREE_SPACE_COST);
+  CostGrid grid = { costs.data(), 200, 200, 0.05, 0.0, 0.0 };
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> cell(20, 179);
+  for (int i = 0; i < 20; ++i)
+  {
+    int ox = cell(rng), oy = cell(rng);
+    for (int y = oy - 10; y <= oy + 10; ++y)
+    {
+      for (int x = ox - 10; x <= ox + 10; ++x)
+      {
+        double distance = std::hypot(x - ox, y - oy);
+        unsigned char cost = distance < 1.0 ? graceful_controller::LETHAL_COST :
+                             distance <= 6.0 ? graceful_controller::INSCRIBED_COST :
+                             distance <= 10.0 ? static_cast<unsigned char>(250 - 20 * (distance - 6.0)) : 0;
+        costs[y * 200 + x] = std::max(costs[y * 200 + x], cost);
+      }
+    }
+  }
+  CostPyramid pyramid;
+  pyramid.update(grid);
+  double radius = std::hypot(0.3, 0.2);
+
+  std::uniform_real_distribution<double> position(2.0, 8.0), yaw(-M_PI, M_PI);
+  std::vector<Pose2D> poses(1024);
+  for (Pose2D& pose : poses)
+  {
+    pose = { position(rng), position(rng), yaw(rng) };
+  }
+
+  size_t i = 0, accepted = 0;
+  for (auto _ : state)
+  {
+    const Pose2D& pose = poses[i++ % poses.size()];
+    if (state.range(0) && pyramid.isFree(pose.x, pose.y, radius))
+    {
+      ++accepted;
+      continue;
+    }
+    benchmark::DoNotOptimize(polygonColliding(grid, footprint, pose.x, pose.y, pose.theta));
+  }
+  state.counters["accepted"] = static_cast<double>(accepted) / i;
+}
+BENCHMARK(BM_FreeSpaceCheck)->ArgName("pyramid")->Arg(0)->Arg(1);
+
+// Update of the max cost pyramid of a 20m, 5cm costmap after a cell changes
+static void BM_CostPyramidUpdate(benchmark::State& state)
+{
+  std::vector<unsigned char> costs(400 * 400, graceful_controller::FREE_SPACE_COST);
+  CostGrid grid = { costs.data(), 400, 400, 0.05, 0.0, 0.0 };
+  CostPyramid pyramid;
+  pyramid.update(grid);
+  for (auto _ : state)
+  {
+    costs[200 * 400 + 200] ^= graceful_controller::LETHAL_COST;
+    benchmark::DoNotOptimize(pyramid.update(grid));
+  }
+}
+BENCHMARK(BM_CostPyramidUpdate);
+
+int main(int argc, char** argv)
+{
+  // Record which kernels this CPU can use, to make sense of batch results
+#if defined(__x86_64__) || defined(__i386__)
+  benchmark::AddCustomContext("avx2", __builtin_cpu_supports("avx2") ? "true" : "false");
+  benchmark::AddCustomContext("avx512f", __builtin_cpu_supports("avx512f") ? "true" : "false");
+#endif
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+  {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
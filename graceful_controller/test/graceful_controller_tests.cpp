@@ -0,0 +1,360 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include <graceful_controller/graceful_controller.hpp>
+
+// Only needed to test each of the vectorized kernels directly
+#include "../src/approach_batch.hpp"
+
+using graceful_controller::GracefulController;
+using graceful_controller::GracefulControllerConstPtr;
+using graceful_controller::VelocityLimits;
+
+// Agreement between the vectorized and scalar control law
+const double BATCH_TOLERANCE = 1e-9;
+
+/**
+ * @brief Targets spread over the local planning window, in structure-of-arrays form.
+ */
+struct Targets
+{
+  Targets()
+  {
+    for (double x = -2.0; x <= 2.0; x += 0.13)
+    {
+      for (double y = -2.0; y <= 2.0; y += 0.17)
+      {
+        for (double theta = -3.1; theta <= 3.1; theta += 0.29)
+        {
+          this->x.push_back(x);
+          this->y.push_back(y);
+          this->theta.push_back(theta);
+        }
+      }
+    }
+    // Straight ahead and straight behind, where signed zeros matter
+    for (double x = -1.0; x <= 1.0; x += 0.5)
+    {
+      this->x.push_back(x);
+      this->y.push_back(0.0);
+      this->theta.push_back(0.0);
+    }
+    // Odd count, so that the scalar remainder is exercised
+    this->x.push_back(0.3);
+    this->y.push_back(0.1);
+    this->theta.push_back(0.2);
+  }
+
+  size_t size() const
+  {
+    return x.size();
+  }
+
+  std::vector<double> x, y, theta;
+};
+
+/**
+ * @brief Discontinuity of the law, where theta + delta wraps around.
+ */
+bool nearDiscontinuity(double x, double y, double theta, bool backward_motion)
+{
+  double delta = backward_motion ? std::atan2(-y, -x) : std::atan2(-y, x);
+  double wrapped = std::remainder(theta + delta, 2.0 * M_PI);
+  return std::hypot(x, y) < 1e-6 || M_PI - std::fabs(wrapped) < 1e-6;
+}
+
+void expectBatchMatchesScalar(GracefulController& controller, bool backward_motion)
+{
+  Targets targets;
+  std::vector<double> vel_x(targets.size()), vel_th(targets.size());
+  controller.approachBatch(targets.x.data(), targets.y.data(), targets.theta.data(),
+                           vel_x.data(), vel_th.data(), targets.size(), backward_motion);
+
+  for (size_t i = 0; i < targets.size(); ++i)
+  {
+    if (nearDiscontinuity(targets.x[i], targets.y[i], targets.theta[i], backward_motion))
+    {
+      continue;
+    }
+    double expected_x, expected_th;
+    controller.approach(targets.x[i], targets.y[i], targets.theta[i], expected_x, expected_th, backward_motion);
+    EXPECT_NEAR(expected_x, vel_x[i], BATCH_TOLERANCE) << "target " << i;
+    EXPECT_NEAR(expected_th, vel_th[i], BATCH_TOLERANCE) << "target " << i;
+  }
+}
+
+/**
+ * @brief The control law as originally implemented, with std::pow.
+ */
+void referenceApproach(double k1, double k2, double min_abs_velocity, double max_abs_velocity,
+                       double max_decel, double max_abs_angular_velocity, double beta, double lambda,
+                       double x, double y, double theta, double& vel_x, double& vel_th)
+{
+  double r = std::sqrt(x * x + y * y);
+  double delta = std::atan2(-y, x);
+  double theta2 = std::remainder(theta + delta, 2.0 * M_PI);
+  double a = std::atan(-k1 * theta2);
+  double k = -1.0/r * (k2 * (delta - a) + (1 + (k1/(1+((k1*theta2)*(k1*theta2)))))*sin(delta));
+  double v = max_abs_velocity / (1 + beta * std::pow(fabs(k), lambda));
+  v = std::min(v, std::sqrt(2 * max_decel * r));
+  v = std::min(std::max(v, min_abs_velocity), max_abs_velocity);
+  double w = k * v;
+  double bounded_w = std::min(max_abs_angular_velocity, std::max(-max_abs_angular_velocity, w));
+  if (w != 0.0)
+  {
+    v *= (bounded_w/w);
+  }
+  vel_x = v;
+  vel_th = bounded_w;
+}
+
+TEST(GracefulControllerTests, test_lambda_kernels)
+{
+  // Integer and half-integer exponents use specialized kernels
+  const double lambdas[] = { 0.0, 0.5, 1.0, 1.5, 2.0, 2.5, 3.0, 4.0, 7.0, 9.5, 1.7, 0.3 };
+  Targets targets;
+  for (double lambda : lambdas)
+  {
+    GracefulController controller(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, lambda);
+    for (size_t i = 0; i < targets.size(); ++i)
+    {
+      if (nearDiscontinuity(targets.x[i], targets.y[i], targets.theta[i], false))
+      {
+        continue;
+      }
+      double vel_x, vel_th, expected_x, expected_th;
+      controller.approach(targets.x[i], targets.y[i], targets.theta[i], vel_x, vel_th);
+      referenceApproach(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, lambda,
+                        targets.x[i], targets.y[i], targets.theta[i], expected_x, expected_th);
+      EXPECT_NEAR(expected_x, vel_x, 1e-12) << "lambda " << lambda << " target " << i;
+      EXPECT_NEAR(expected_th, vel_th, 1e-12) << "lambda " << lambda << " target " << i;
+    }
+  }
+}
+
+TEST(GracefulControllerTests, test_batch_forward)
+{
+  GracefulController controller(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, 2.0);
+  expectBatchMatchesScalar(controller, false);
+}
+
+TEST(GracefulControllerTests, test_batch_backward)
+{
+  GracefulController controller(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, 2.0);
+  expectBatchMatchesScalar(controller, true);
+}
+
+TEST(GracefulControllerTests, test_batch_lambda)
+{
+  // Non-integer exponent goes through the full pow() path
+  GracefulController fractional(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, 1.7);
+  expectBatchMatchesScalar(fractional, false);
+
+  // Zero exponent disables curvature based speed reduction
+  GracefulController zero(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, 0.0);
+  expectBatchMatchesScalar(zero, false);
+
+  // Half-integer exponent uses a specialized kernel
+  GracefulController half(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, 2.5);
+  expectBatchMatchesScalar(half, false);
+}
+
+TEST(GracefulControllerTests, test_batch_kernels)
+{
+  // Each kernel, even if a wider one would be preferred on this CPU
+  graceful_controller::detail::BatchParameters params;
+  params.k1 = 2.0;
+  params.k2 = 1.0;
+  params.min_abs_velocity = 0.1;
+  params.max_abs_velocity = 1.0;
+  params.max_abs_velocities = nullptr;
+  params.max_decel = 0.5;
+  params.max_abs_angular_velocity = 1.0;
+  params.beta = 0.4;
+  params.lambda = 2.0;
+  GracefulController controller(params.k1, params.k2, params.min_abs_velocity, params.max_abs_velocity,
+                                params.max_decel, params.max_abs_angular_velocity, params.beta, params.lambda);
+
+  typedef size_t (*Kernel)(const graceful_controller::detail::BatchParameters&,
+                          const double*, const double*, const double*,
+                          double*, double*, size_t, bool);
+  std::vector<Kernel> kernels;
+#ifdef GRACEFUL_CONTROLLER_HAVE_AVX2
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+  {
+    kernels.push_back(&graceful_controller::detail::approachBatchAVX2);
+  }
+#endif
+#ifdef GRACEFUL_CONTROLLER_HAVE_AVX512
+  if (__builtin_cpu_supports("avx512f"))
+  {
+    kernels.push_back(&graceful_controller::detail::approachBatchAVX512);
+  }
+#endif
+
+  Targets targets;
+  for (size_t kernel = 0; kernel < kernels.size(); ++kernel)
+  {
+    std::vector<double> vel_x(targets.size()), vel_th(targets.size());
+    size_t done = kernels[kernel](params, targets.x.data(), targets.y.data(), targets.theta.data(),
+                                  vel_x.data(), vel_th.data(), targets.size(), false);
+    // Only a partial vector should be left over
+    EXPECT_LT(targets.size() - done, 8u);
+    for (size_t i = 0; i < done; ++i)
+    {
+      if (nearDiscontinuity(targets.x[i], targets.y[i], targets.theta[i], false))
+      {
+        continue;
+      }
+      double expected_x, expected_th;
+      controller.approach(targets.x[i], targets.y[i], targets.theta[i], expected_x, expected_th);
+      EXPECT_NEAR(expected_x, vel_x[i], BATCH_TOLERANCE) << "kernel " << kernel << " target " << i;
+      EXPECT_NEAR(expected_th, vel_th[i], BATCH_TOLERANCE) << "kernel " << kernel << " target " << i;
+    }
+  }
+}
+
+/**
+ * @brief Bitwise agreement, where NaN (target at the robot origin) matches NaN.
+ */
+bool identical(double a, double b)
+{
+  return a == b || (std::isnan(a) && std::isnan(b));
+}
+
+TEST(GracefulControllerTests, test_velocity_limits_per_call)
+{
+  GracefulController controller(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, 2.0);
+  GracefulController reference(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, 2.0);
+
+  Targets targets;
+  const double caps[] = { 1.0, 0.6, 0.25 };
+  for (double cap : caps)
+  {
+    VelocityLimits limits = { 0.1, cap, 0.8 };
+    reference.setVelocityLimits(0.1, cap, 0.8);
+
+    std::vector<double> batch_x(targets.size()), batch_th(targets.size());
+    controller.approachBatch(targets.x.data(), targets.y.data(), targets.theta.data(), limits,
+                             batch_x.data(), batch_th.data(), targets.size());
+
+    for (size_t i = 0; i < targets.size(); ++i)
+    {
+      double vel_x, vel_th, expected_x, expected_th;
+      controller.approach(targets.x[i], targets.y[i], targets.theta[i], limits, vel_x, vel_th);
+      reference.approach(targets.x[i], targets.y[i], targets.theta[i], expected_x, expected_th);
+      EXPECT_TRUE(identical(expected_x, vel_x)) << "target " << i;
+      EXPECT_TRUE(identical(expected_th, vel_th)) << "target " << i;
+      if (!nearDiscontinuity(targets.x[i], targets.y[i], targets.theta[i], false))
+      {
+        EXPECT_NEAR(expected_x, batch_x[i], BATCH_TOLERANCE);
+        EXPECT_NEAR(expected_th, batch_th[i], BATCH_TOLERANCE);
+      }
+    }
+  }
+
+  // Per-call limits do not change the defaults
+  EXPECT_EQ(1.0, controller.getVelocityLimits().max_abs_velocity);
+  EXPECT_EQ(1.0, controller.getVelocityLimits().max_abs_angular_velocity);
+}
+
+TEST(GracefulControllerTests, test_velocity_cap_per_lane)
+{
+  GracefulController controller(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, 2.0);
+
+  // Every target at a different cap, cycling through more caps than any vector has lanes
+  Targets targets;
+  std::vector<double> caps(targets.size());
+  for (size_t i = 0; i < targets.size(); ++i)
+  {
+    caps[i] = 1.0 - 0.1 * (i % 11);
+  }
+
+  VelocityLimits limits = { 0.1, 1.0, 0.8 };
+  std::vector<double> batch_x(targets.size()), batch_th(targets.size());
+  controller.approachBatch(targets.x.data(), targets.y.data(), targets.theta.data(), limits, caps.data(),
+                           batch_x.data(), batch_th.data(), targets.size());
+
+  for (size_t i = 0; i < targets.size(); ++i)
+  {
+    if (nearDiscontinuity(targets.x[i], targets.y[i], targets.theta[i], false))
+    {
+      continue;
+    }
+    VelocityLimits lane_limits = { 0.1, caps[i], 0.8 };
+    double expected_x, expected_th;
+    controller.approach(targets.x[i], targets.y[i], targets.theta[i], lane_limits, expected_x, expected_th);
+    EXPECT_NEAR(expected_x, batch_x[i], BATCH_TOLERANCE) << "target " << i;
+    EXPECT_NEAR(expected_th, batch_th[i], BATCH_TOLERANCE) << "target " << i;
+  }
+}
+
+TEST(GracefulControllerTests, test_shared_controller)
+{
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 1.0, 0.5, 1.0, 0.4, 1.7);
+  Targets targets;
+
+  // Each thread evaluates every target with its own velocity cap
+  const size_t num_threads = 4;
+  std::vector<std::vector<double>> vel_x(num_threads), vel_th(num_threads);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_threads; ++t)
+  {
+    threads.emplace_back([&, t]()
+    {
+      VelocityLimits limits = { 0.1, 1.0 - 0.2 * t, 1.0 };
+      vel_x[t].resize(targets.size());
+      vel_th[t].resize(targets.size());
+      for (size_t i = 0; i < targets.size(); ++i)
+      {
+        controller->approach(targets.x[i], targets.y[i], targets.theta[i], limits, vel_x[t][i], vel_th[t][i]);
+      }
+    });
+  }
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+
+  for (size_t t = 0; t < num_threads; ++t)
+  {
+    VelocityLimits limits = { 0.1, 1.0 - 0.2 * t, 1.0 };
+    for (size_t i = 0; i < targets.size(); ++i)
+    {
+      double expected_x, expected_th;
+      controller->approach(targets.x[i], targets.y[i], targets.theta[i], limits, expected_x, expected_th);
+      EXPECT_TRUE(identical(expected_x, vel_x[t][i])) << "thread " << t << " target " << i;
+      EXPECT_TRUE(identical(expected_th, vel_th[t][i])) << "thread " << t << " target " << i;
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,1146 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <graceful_controller/graceful_rollout.hpp>
+#include <graceful_controller/rollout_cache.hpp>
+
+using graceful_controller::CollisionChecker;
+using graceful_controller::GracefulController;
+using graceful_controller::GracefulControllerConstPtr;
+using graceful_controller::GracefulRollout;
+using graceful_controller::MathBackend;
+using graceful_controller::Pose2D;
+using graceful_controller::RolloutCache;
+using graceful_controller::RolloutIntegrator;
+using graceful_controller::RolloutParameters;
+using graceful_controller::RolloutResult;
+using graceful_controller::RolloutStatus;
+using graceful_controller::TrajectoryBuffer;
+using graceful_controller::Transform2D;
+using graceful_controller::VelocityLimits;
+using graceful_controller::bisectCaps;
+using graceful_controller::gallopSearch;
+
+// Count heap allocations, to check that rollouts do not allocate. Every
+// replaceable form is overridden, so that each new is matched by its delete.
+static size_t allocations = 0;
+
+static void* countedAllocation(size_t size)
+{
+  ++allocations;
+  void* ptr = std::malloc(size ? size : 1);
+  if (!ptr)
+  {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void* operator new(size_t size)
+{
+  return countedAllocation(size);
+}
+
+void* operator new[](size_t size)
+{
+  return countedAllocation(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+  std::free(ptr);
+}
+
+/*
+ * Reference implementation: GracefulControllerROS::simulate() as it was
+ * written against geometry_msgs, with stand-ins for the messages and tf2.
+ */
+
+struct Quaternion
+{
+  double x, y, z, w;
+};
+
+struct Pose
+{
+  double x, y;
+  Quaternion orientation;
+};
+
+// tf2::getYaw()
+double getYaw(const Quaternion& q)
+{
+  double sqx = q.x * q.x;
+  double sqy = q.y * q.y;
+  double sqz = q.z * q.z;
+  double sqw = q.w * q.w;
+  double sarg = -2 * (q.x * q.z - q.w * q.y) / (sqx + sqy + sqz + sqw);
+  if (sarg <= -0.99999)
+  {
+    return -2 * std::atan2(q.y, q.x);
+  }
+  else if (sarg >= 0.99999)
+  {
+    return 2 * std::atan2(q.y, q.x);
+  }
+  return std::atan2(2 * (q.x * q.y + q.w * q.z), sqw + sqx - sqy - sqz);
+}
+
+Quaternion fromYaw(double yaw)
+{
+  Quaternion q = { 0.0, 0.0, std::sin(yaw / 2.0), std::cos(yaw / 2.0) };
+  return q;
+}
+
+double referenceRotateTowards(const Pose& pose, const RolloutParameters& params, double& vel_th)
+{
+  double yaw = 0.0;
+  if (std::hypot(pose.x, pose.y) > 0.5)
+  {
+    yaw = std::atan2(pose.y, pose.x);
+  }
+  else
+  {
+    yaw = getYaw(pose.orientation);
+  }
+  vel_th = std::sqrt(2 * params.acc_lim_theta * fabs(yaw));
+  vel_th = (yaw < 0.0 ? -1.0 : 1.0) * std::min(params.max_vel_theta, std::max(params.min_in_place_vel_theta, vel_th));
+  return yaw;
+}
+
+RolloutStatus referenceSimulate(const GracefulController& controller, const RolloutParameters& params,
+                                const VelocityLimits& limits, bool initial_rotation, const Pose& target_pose,
+                                const CollisionChecker& is_colliding, size_t max_size,
+                                std::vector<Pose>& simulated_path, double& cmd_vel_x, double& cmd_vel_th)
+{
+  simulated_path.clear();
+  bool sim_initial_rotation = initial_rotation && params.initial_rotate_tolerance > 0.0;
+  while (true)
+  {
+    Pose error = target_pose;
+    double error_angle = getYaw(error.orientation);
+    if (!simulated_path.empty())
+    {
+      double x = error.x - simulated_path.back().x;
+      double y = error.y - simulated_path.back().y;
+      double theta = -getYaw(simulated_path.back().orientation);
+      error.x = x * cos(theta) - y * sin(theta);
+      error.y = y * cos(theta) + x * sin(theta);
+      error_angle += theta;
+      error.orientation = fromYaw(error_angle);
+    }
+
+    double vel_x, vel_th;
+    if (sim_initial_rotation)
+    {
+      if (fabs(referenceRotateTowards(error, params, vel_th)) < params.initial_rotate_tolerance)
+      {
+        sim_initial_rotation = false;
+      }
+      vel_x = 0.0;
+    }
+
+    if (!sim_initial_rotation)
+    {
+      controller.approach(error.x, error.y, error_angle, limits, vel_x, vel_th);
+    }
+
+    if (simulated_path.empty())
+    {
+      cmd_vel_x = vel_x;
+      cmd_vel_th = vel_th;
+    }
+    else if (std::hypot(error.x, error.y) < params.resolution)
+    {
+      return RolloutStatus::SUCCESS;
+    }
+
+    // Not in the original, which simulated until off the costmap
+    if (simulated_path.size() == max_size)
+    {
+      return RolloutStatus::BUFFER_FULL;
+    }
+
+    Pose next_pose;
+    if (simulated_path.empty())
+    {
+      next_pose.x = next_pose.y = 0.0;
+      next_pose.orientation = { 0.0, 0.0, 0.0, 1.0 };
+    }
+    else
+    {
+      next_pose = simulated_path.back();
+    }
+
+    double dt = (vel_x > 0.0) ? params.resolution / vel_x : 0.1;
+    double yaw = getYaw(next_pose.orientation);
+    next_pose.x += dt * vel_x * cos(yaw);
+    next_pose.y += dt * vel_x * sin(yaw);
+    yaw += dt * vel_th;
+    next_pose.orientation = fromYaw(yaw);
+    simulated_path.push_back(next_pose);
+
+    double footprint_scaling = 1.0;
+    if (vel_x > params.scaling_vel_x)
+    {
+      double ratio = params.max_vel_x - params.scaling_vel_x;
+      if (ratio > 0)
+      {
+        ratio = (vel_x - params.scaling_vel_x) / ratio;
+        footprint_scaling += ratio * params.scaling_factor;
+      }
+    }
+
+    Pose2D pose = { next_pose.x, next_pose.y, yaw };
+    if (is_colliding(pose, footprint_scaling))
+    {
+      return RolloutStatus::COLLISION;
+    }
+  }
+}
+
+RolloutParameters defaultParameters()
+{
+  RolloutParameters params;
+  params.resolution = 0.05;
+  params.initial_rotate_tolerance = 0.1;
+  params.max_vel_theta = 1.0;
+  params.min_in_place_vel_theta = 0.4;
+  params.acc_lim_theta = 2.0;
+  params.max_vel_x = 0.5;
+  params.scaling_vel_x = 0.25;
+  params.scaling_factor = 0.5;
+  return params;
+}
+
+// A round obstacle, tested against the (scaled) circular robot
+CollisionChecker obstacle(double x, double y, double radius)
+{
+  return [x, y, radius](const Pose2D& pose, double footprint_scaling)
+  {
+    return std::hypot(pose.x - x, pose.y - y) < radius + 0.2 * footprint_scaling;
+  };
+}
+
+TEST(GracefulRolloutTests, test_matches_reference)
+{
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0);
+  RolloutParameters params = defaultParameters();
+  GracefulRollout rollout(controller, params);
+
+  std::vector<Pose2D> storage(2000);
+  std::vector<Pose> reference_path;
+
+  const CollisionChecker checkers[] = { obstacle(10.0, 10.0, 0.1), obstacle(0.8, 0.3, 0.2) };
+  size_t collisions = 0, successes = 0;
+  for (const CollisionChecker& is_colliding : checkers)
+  {
+    for (double x = -1.5; x <= 1.5; x += 0.5)
+    {
+      for (double y = -1.5; y <= 1.5; y += 0.5)
+      {
+        for (double yaw = -3.0; yaw <= 3.0; yaw += 0.75)
+        {
+          for (int initial_rotation = 0; initial_rotation < 2; ++initial_rotation)
+          {
+            if (std::hypot(x, y) < 0.1)
+            {
+              // Control law is undefined at the robot
+              continue;
+            }
+            VelocityLimits limits = { 0.1, (x > 0) ? 0.5 : 0.3, 1.0 };
+            Pose target = { x, y, fromYaw(yaw) };
+            Pose2D target2d = { x, y, getYaw(target.orientation) };
+
+            double expected_x, expected_th;
+            RolloutStatus expected = referenceSimulate(*controller, params, limits, initial_rotation, target,
+                                                       is_colliding, storage.size(), reference_path,
+                                                       expected_x, expected_th);
+
+            TrajectoryBuffer trajectory(storage.data(), storage.size());
+            RolloutResult result = rollout.simulate(target2d, limits, initial_rotation, is_colliding, trajectory);
+
+            EXPECT_EQ(expected, result.status);
+            EXPECT_EQ(expected_x, result.vel_x);
+            EXPECT_EQ(expected_th, result.vel_th);
+            ASSERT_EQ(reference_path.size(), trajectory.size);
+            for (size_t i = 0; i < trajectory.size; ++i)
+            {
+              EXPECT_EQ(reference_path[i].x, trajectory.poses[i].x);
+              EXPECT_EQ(reference_path[i].y, trajectory.poses[i].y);
+              EXPECT_EQ(getYaw(reference_path[i].orientation), getYaw(fromYaw(trajectory.poses[i].theta)));
+            }
+            successes += (expected == RolloutStatus::SUCCESS);
+            collisions += (expected == RolloutStatus::COLLISION);
+          }
+        }
+      }
+    }
+  }
+  // Both outcomes should have been exercised
+  EXPECT_GT(successes, 0u);
+  EXPECT_GT(collisions, 0u);
+}
+
+TEST(GracefulRolloutTests, test_initial_rotation)
+{
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0);
+  GracefulRollout rollout(controller, defaultParameters());
+  std::vector<Pose2D> storage(2000);
+  CollisionChecker free_space = obstacle(10.0, 10.0, 0.1);
+
+  // Target behind the robot, should rotate in place first
+  Pose2D target = { -1.0, 0.0, 0.0 };
+  VelocityLimits limits = { 0.1, 0.5, 1.0 };
+  TrajectoryBuffer trajectory(storage.data(), storage.size());
+  RolloutResult result = rollout.simulate(target, limits, true, free_space, trajectory);
+  EXPECT_EQ(RolloutStatus::SUCCESS, result.status);
+  EXPECT_EQ(0.0, result.vel_x);
+  EXPECT_EQ(1.0, result.vel_th);
+  EXPECT_FALSE(result.initially_aligned);
+  EXPECT_EQ(0.0, trajectory.poses[0].x);
+
+  // Target ahead of the robot is already aligned
+  target.x = 1.0;
+  result = rollout.simulate(target, limits, true, free_space, trajectory);
+  EXPECT_EQ(RolloutStatus::SUCCESS, result.status);
+  EXPECT_TRUE(result.initially_aligned);
+  EXPECT_GT(result.vel_x, 0.0);
+}
+
+TEST(GracefulRolloutTests, test_buffer_full)
+{
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0);
+  GracefulRollout rollout(controller, defaultParameters());
+  std::vector<Pose2D> storage(10);
+
+  Pose2D target = { 2.0, 0.0, 0.0 };
+  VelocityLimits limits = { 0.1, 0.5, 1.0 };
+  TrajectoryBuffer trajectory(storage.data(), storage.size());
+  RolloutResult result = rollout.simulate(target, limits, false, obstacle(10.0, 10.0, 0.1), trajectory);
+  EXPECT_EQ(RolloutStatus::BUFFER_FULL, result.status);
+  EXPECT_EQ(10u, trajectory.size);
+}
+
+TEST(GracefulRolloutTests, test_no_allocations)
+{
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0);
+  GracefulRollout rollout(controller, defaultParameters());
+  std::vector<Pose2D> storage(2000);
+  CollisionChecker is_colliding = obstacle(0.8, 0.3, 0.2);
+
+  size_t before = allocations;
+  for (double y = -1.0; y <= 1.0; y += 0.1)
+  {
+    Pose2D target = { 1.5, y, 0.0 };
+    VelocityLimits limits = { 0.1, 0.5, 1.0 };
+    TrajectoryBuffer trajectory(storage.data(), storage.size());
+    rollout.simulate(target, limits, true, is_colliding, trajectory);
+  }
+  EXPECT_EQ(before, allocations);
+}
+
+TEST(GracefulRolloutTests, test_simulate_caps)
+{
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0);
+  GracefulRollout rollout(controller, defaultParameters());
+
+  // More caps than simulated in lockstep, so that they are split into groups
+  std::vector<double> caps;
+  for (double cap = 0.5; cap >= 0.1; cap -= 0.02)
+  {
+    caps.push_back(cap);
+  }
+  std::vector<std::vector<Pose2D>> storage(caps.size(), std::vector<Pose2D>(2000));
+  std::vector<TrajectoryBuffer> trajectories;
+  for (std::vector<Pose2D>& poses : storage)
+  {
+    trajectories.emplace_back(poses.data(), poses.size());
+  }
+  std::vector<RolloutResult> results(caps.size());
+  std::vector<Pose2D> sequential_storage(2000);
+
+  // The scaled footprint only passes the obstacle at lower velocities
+  CollisionChecker is_colliding = obstacle(0.7, 0.35, 0.1);
+  size_t slower = 0, none = 0;
+  for (double y = -1.0; y <= 1.0; y += 0.1)
+  {
+    for (double yaw = -1.5; yaw <= 1.5; yaw += 0.5)
+    {
+      for (int initial_rotation = 0; initial_rotation < 2; ++initial_rotation)
+      {
+        Pose2D target = { 1.2, y, yaw };
+        VelocityLimits limits = { 0.1, 0.5, 1.0 };
+
+        // Expected: the fastest cap that succeeds on its own
+        size_t expected = caps.size();
+        RolloutResult expected_result;
+        TrajectoryBuffer sequential(sequential_storage.data(), sequential_storage.size());
+        for (size_t i = 0; i < caps.size() && expected == caps.size(); ++i)
+        {
+          limits.max_abs_velocity = caps[i];
+          expected_result = rollout.simulate(target, limits, initial_rotation, is_colliding, sequential);
+          if (expected_result.status == RolloutStatus::SUCCESS)
+          {
+            expected = i;
+          }
+        }
+
+        size_t best = rollout.simulateCaps(target, limits, caps.data(), caps.size(), initial_rotation,
+                                           is_colliding, trajectories.data(), results.data());
+        ASSERT_EQ(expected, best) << "target " << y << " " << yaw;
+        slower += (best > 0 && best < caps.size());
+        none += (best == caps.size());
+        if (best == caps.size())
+        {
+          continue;
+        }
+        EXPECT_EQ(RolloutStatus::SUCCESS, results[best].status);
+        EXPECT_NEAR(expected_result.vel_x, results[best].vel_x, 1e-9);
+        EXPECT_NEAR(expected_result.vel_th, results[best].vel_th, 1e-9);
+        EXPECT_EQ(expected_result.initially_aligned, results[best].initially_aligned);
+        EXPECT_EQ(sequential.size, trajectories[best].size);
+        for (size_t i = 0; i < best; ++i)
+        {
+          EXPECT_NE(RolloutStatus::SUCCESS, results[i].status);
+        }
+      }
+    }
+  }
+  // Some targets need a slower cap, some can not be reached at all
+  EXPECT_GT(slower, 0u);
+  EXPECT_GT(none, 0u);
+
+  // Lockstep caps do not allocate either
+  size_t before = allocations;
+  Pose2D target = { 1.2, 0.3, 0.0 };
+  VelocityLimits limits = { 0.1, 0.5, 1.0 };
+  rollout.simulateCaps(target, limits, caps.data(), caps.size(), true, is_colliding, trajectories.data(),
+                       results.data());
+  EXPECT_EQ(before, allocations);
+}
+
+TEST(GracefulRolloutTests, test_simulate_caps_collision_boundary)
+{
+  // Lockstep commands agree with simulate() only to within the tolerance of
+  // approachBatch(). Moving an obstacle across the path in small steps, so that
+  // the fastest cap to pass it changes, still picks the same cap either way.
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0);
+  GracefulRollout rollout(controller, defaultParameters());
+  std::vector<double> caps;
+  for (double cap = 0.5; cap >= 0.1; cap -= 0.01)
+  {
+    caps.push_back(cap);
+  }
+  std::vector<std::vector<Pose2D>> storage(caps.size(), std::vector<Pose2D>(2000));
+  std::vector<TrajectoryBuffer> trajectories;
+  for (std::vector<Pose2D>& poses : storage)
+  {
+    trajectories.emplace_back(poses.data(), poses.size());
+  }
+  std::vector<RolloutResult> results(caps.size());
+  std::vector<Pose2D> sequential_storage(2000);
+
+  Pose2D target = { 1.2, 0.2, 0.3 };
+  VelocityLimits limits = { 0.1, 0.5, 1.0 };
+  size_t changes = 0;
+  size_t previous = caps.size() + 1;
+  for (double y = 0.3; y <= 0.45; y += 0.0005)
+  {
+    CollisionChecker is_colliding = obstacle(0.7, y, 0.1);
+    size_t expected = caps.size();
+    TrajectoryBuffer sequential(sequential_storage.data(), sequential_storage.size());
+    for (size_t i = 0; i < caps.size() && expected == caps.size(); ++i)
+    {
+      limits.max_abs_velocity = caps[i];
+      if (rollout.simulate(target, limits, false, is_colliding, sequential).status == RolloutStatus::SUCCESS)
+      {
+        expected = i;
+      }
+    }
+    size_t best = rollout.simulateCaps(target, limits, caps.data(), caps.size(), false, is_colliding,
+                                       trajectories.data(), results.data());
+    EXPECT_EQ(expected, best) << "obstacle at " << y;
+    changes += (previous <= caps.size() && best != previous);
+    previous = best;
+  }
+  // The sweep crossed several collision boundaries
+  EXPECT_GT(changes, 2u);
+}
+
+TEST(GracefulRolloutTests, test_simulate_caps_backends)
+{
+  // Lockstep caps pick the same cap as simulating one at a time, whatever the
+  // math backend, as a batch of the control law uses the backend for every lane
+  std::vector<double> caps;
+  for (double cap = 0.5; cap >= 0.1; cap -= 0.05)
+  {
+    caps.push_back(cap);
+  }
+  std::vector<std::vector<Pose2D>> storage(caps.size(), std::vector<Pose2D>(2000));
+  std::vector<TrajectoryBuffer> trajectories;
+  for (std::vector<Pose2D>& poses : storage)
+  {
+    trajectories.emplace_back(poses.data(), poses.size());
+  }
+  std::vector<RolloutResult> results(caps.size());
+  std::vector<Pose2D> sequential_storage(2000);
+  CollisionChecker is_colliding = obstacle(0.7, 0.35, 0.1);
+
+  for (MathBackend backend : { MathBackend::EXACT, MathBackend::APPROXIMATE, MathBackend::LOOKUP_TABLE })
+  {
+    GracefulControllerConstPtr controller =
+        std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0, backend);
+    GracefulRollout rollout(controller, defaultParameters());
+    for (double y = -1.0; y <= 1.0; y += 0.2)
+    {
+      for (double yaw = -1.5; yaw <= 1.5; yaw += 0.5)
+      {
+        Pose2D target = { 1.2, y, yaw };
+        VelocityLimits limits = { 0.1, 0.5, 1.0 };
+        size_t expected = caps.size();
+        RolloutResult expected_result;
+        TrajectoryBuffer sequential(sequential_storage.data(), sequential_storage.size());
+        for (size_t i = 0; i < caps.size() && expected == caps.size(); ++i)
+        {
+          limits.max_abs_velocity = caps[i];
+          expected_result = rollout.simulate(target, limits, false, is_colliding, sequential);
+          if (expected_result.status == RolloutStatus::SUCCESS)
+          {
+            expected = i;
+          }
+        }
+
+        size_t best = rollout.simulateCaps(target, limits, caps.data(), caps.size(), false, is_colliding,
+                                           trajectories.data(), results.data());
+        ASSERT_EQ(expected, best) << "backend " << static_cast<int>(backend) << ", target " << y << " " << yaw;
+        if (best < caps.size())
+        {
+          EXPECT_NEAR(expected_result.vel_x, results[best].vel_x, 1e-9);
+          EXPECT_NEAR(expected_result.vel_th, results[best].vel_th, 1e-9);
+          EXPECT_EQ(sequential.size, trajectories[best].size);
+        }
+      }
+    }
+  }
+}
+
+TEST(GracefulRolloutTests, test_incremental_rotation)
+{
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0);
+  std::vector<Pose2D> storage(2000), incremental_storage(2000);
+  CollisionChecker free_space = obstacle(10.0, 10.0, 0.1);
+
+  for (RolloutIntegrator integrator : { RolloutIntegrator::EULER, RolloutIntegrator::ARC })
+  {
+    RolloutParameters params = defaultParameters();
+    params.integrator = integrator;
+    GracefulRollout rollout(controller, params);
+    params.incremental_rotation = true;
+    GracefulRollout incremental(controller, params);
+
+    // Headings away from the discontinuity of the law, and targets off the grid of the
+    // thresholds on distance, where rounding can select either side
+    double worst = 0.0;
+    for (double x = -1.487; x <= 1.5; x += 0.5)
+    {
+      for (double y = -1.513; y <= 1.5; y += 0.5)
+      {
+        for (double yaw = -1.5; yaw <= 1.5; yaw += 0.5)
+        {
+          if (std::hypot(x, y) < 0.1)
+          {
+            continue;
+          }
+          Pose2D target = { x, y, yaw };
+          VelocityLimits limits = { 0.1, 0.5, 1.0 };
+          TrajectoryBuffer trajectory(storage.data(), storage.size());
+          TrajectoryBuffer incremental_trajectory(incremental_storage.data(), incremental_storage.size());
+          RolloutResult expected = rollout.simulate(target, limits, true, free_space, trajectory);
+          RolloutResult result = incremental.simulate(target, limits, true, free_space, incremental_trajectory);
+
+          // Same command, the first step does not depend on the heading
+          EXPECT_EQ(expected.status, result.status);
+          EXPECT_EQ(expected.vel_x, result.vel_x);
+          EXPECT_EQ(expected.vel_th, result.vel_th);
+          ASSERT_GT(trajectory.size, 0u);
+          ASSERT_GT(incremental_trajectory.size, 0u);
+          const Pose2D& end = trajectory.poses[trajectory.size - 1];
+          const Pose2D& incremental_end = incremental_trajectory.poses[incremental_trajectory.size - 1];
+          worst = std::max(worst, std::hypot(end.x - incremental_end.x, end.y - incremental_end.y));
+          worst = std::max(worst, std::fabs(std::remainder(end.theta - incremental_end.theta, 2.0 * M_PI)));
+
+          // The arc steps adapt to the change of the command, rounding can split one of them
+          if (integrator == RolloutIntegrator::EULER)
+          {
+            ASSERT_EQ(trajectory.size, incremental_trajectory.size);
+            for (size_t i = 0; i < trajectory.size; ++i)
+            {
+              const Pose2D& a = trajectory.poses[i];
+              const Pose2D& b = incremental_trajectory.poses[i];
+              worst = std::max(worst, std::hypot(a.x - b.x, a.y - b.y));
+              worst = std::max(worst, std::fabs(std::remainder(a.theta - b.theta, 2.0 * M_PI)));
+            }
+          }
+        }
+      }
+    }
+    // Only rounding differs
+    EXPECT_LT(worst, 1e-9);
+  }
+}
+
+TEST(GracefulRolloutTests, test_transform)
+{
+  Transform2D transform(1.0, -2.0, 0.7);
+  Pose2D pose = { 0.5, 0.25, -0.2 };
+
+  // Same as rotating, then translating
+  Pose2D result = transform.apply(pose);
+  EXPECT_NEAR(1.0 + 0.5 * std::cos(0.7) - 0.25 * std::sin(0.7), result.x, 1e-12);
+  EXPECT_NEAR(-2.0 + 0.5 * std::sin(0.7) + 0.25 * std::cos(0.7), result.y, 1e-12);
+  EXPECT_NEAR(0.5, result.theta, 1e-12);
+
+  // Round trip through the inverse
+  Pose2D back = transform.inverse().apply(result);
+  EXPECT_NEAR(pose.x, back.x, 1e-12);
+  EXPECT_NEAR(pose.y, back.y, 1e-12);
+  EXPECT_NEAR(pose.theta, back.theta, 1e-12);
+}
+
+TEST(GracefulRolloutTests, test_arc_integration)
+{
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0);
+  RolloutParameters params = defaultParameters();
+  params.resolution = 0.025;
+  GracefulRollout euler(controller, params);
+  params.integrator = RolloutIntegrator::ARC;
+  params.footprint_radius = 0.3;
+  GracefulRollout arc(controller, params);
+
+  std::vector<Pose2D> euler_storage(2000), arc_storage(2000);
+  CollisionChecker free_space = obstacle(10.0, 10.0, 0.1);
+  size_t euler_evaluations = 0, arc_evaluations = 0;
+  for (double y = -1.0; y <= 1.0; y += 0.25)
+  {
+    for (double yaw = -1.0; yaw <= 1.0; yaw += 0.5)
+    {
+      Pose2D target = { 2.0, y, yaw };
+      VelocityLimits limits = { 0.1, 0.5, 1.0 };
+      TrajectoryBuffer euler_trajectory(euler_storage.data(), euler_storage.size());
+      TrajectoryBuffer arc_trajectory(arc_storage.data(), arc_storage.size());
+      RolloutResult euler_result = euler.simulate(target, limits, false, free_space, euler_trajectory);
+      RolloutResult arc_result = arc.simulate(target, limits, false, free_space, arc_trajectory);
+      ASSERT_EQ(RolloutStatus::SUCCESS, euler_result.status);
+      ASSERT_EQ(RolloutStatus::SUCCESS, arc_result.status);
+      euler_evaluations += euler_result.evaluations;
+      arc_evaluations += arc_result.evaluations;
+      if (y == 0.0 && yaw == 0.0)
+      {
+        // Straight ahead, steps grow to max_step_length
+        EXPECT_LT(4 * arc_result.evaluations, euler_result.evaluations);
+      }
+
+      // The first command does not depend on the integrator
+      EXPECT_EQ(euler_result.vel_x, arc_result.vel_x);
+      EXPECT_EQ(euler_result.vel_th, arc_result.vel_th);
+
+      // Both end up at the target
+      const Pose2D& end = arc_trajectory.poses[arc_trajectory.size - 1];
+      EXPECT_LT(std::hypot(end.x - target.x, end.y - target.y), params.resolution);
+
+      // No point of the footprint moves more than resolution between checked poses
+      Pose2D previous = { 0.0, 0.0, 0.0 };
+      for (size_t i = 0; i < arc_trajectory.size; ++i)
+      {
+        const Pose2D& pose = arc_trajectory.poses[i];
+        double sweep = std::hypot(pose.x - previous.x, pose.y - previous.y) +
+                       params.footprint_radius * std::fabs(pose.theta - previous.theta);
+        EXPECT_LE(sweep, params.resolution * (1.0 + 1e-9)) << "pose " << i;
+        previous = pose;
+      }
+    }
+  }
+  // Far fewer evaluations of the control law
+  EXPECT_LT(2 * arc_evaluations, euler_evaluations);
+}
+
+TEST(GracefulRolloutTests, test_arc_collision)
+{
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0);
+  RolloutParameters params = defaultParameters();
+  params.integrator = RolloutIntegrator::ARC;
+  params.max_step_length = 1.0;
+  GracefulRollout rollout(controller, params);
+  std::vector<Pose2D> storage(2000);
+
+  // A thin wall across the path, which a single long step would jump over
+  CollisionChecker wall = [](const Pose2D& pose, double)
+  {
+    return std::fabs(pose.x - 1.0) < 0.01;
+  };
+  Pose2D target = { 2.0, 0.0, 0.0 };
+  VelocityLimits limits = { 0.1, 0.5, 1.0 };
+  TrajectoryBuffer trajectory(storage.data(), storage.size());
+  RolloutResult result = rollout.simulate(target, limits, false, wall, trajectory);
+  EXPECT_EQ(RolloutStatus::COLLISION, result.status);
+  EXPECT_LT(result.evaluations, trajectory.size);
+}
+
+TEST(GracefulRolloutTests, test_rollout_cache)
+{
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0);
+  GracefulRollout rollout(controller, defaultParameters());
+  RolloutCache cache(8, 2000, 2000, 0.01);
+  std::vector<Pose2D> storage(2000), expected_storage(2000);
+
+  // Count the collision checks
+  size_t checks = 0;
+  CollisionChecker free_space = obstacle(10.0, 10.0, 0.1);
+  CollisionChecker counting = [&checks, &free_space](const Pose2D& pose, double footprint_scaling)
+  {
+    ++checks;
+    return free_space(pose, footprint_scaling);
+  };
+
+  Pose2D target = { 1.0, 0.3, 0.2 };
+  VelocityLimits limits = { 0.1, 0.5, 1.0 };
+  TrajectoryBuffer expected_trajectory(expected_storage.data(), expected_storage.size());
+  RolloutResult expected = rollout.simulate(target, limits, false, free_space, expected_trajectory);
+  ASSERT_EQ(RolloutStatus::SUCCESS, expected.status);
+
+  // Miss, simulates
+  TrajectoryBuffer trajectory(storage.data(), storage.size());
+  RolloutResult result = cache.simulate(rollout, target, limits, false, counting, 1, trajectory);
+  EXPECT_EQ(expected.status, result.status);
+  EXPECT_EQ(expected.evaluations, result.evaluations);
+  EXPECT_EQ(expected_trajectory.size, checks);
+  EXPECT_EQ(0u, cache.getHits());
+  EXPECT_EQ(1u, cache.getMisses());
+  EXPECT_EQ(1u, cache.size());
+
+  // Hit within the resolution, same generation: no control law, no collision checks
+  checks = 0;
+  Pose2D nearby = { 1.002, 0.298, 0.201 };
+  result = cache.simulate(rollout, nearby, limits, false, counting, 1, trajectory);
+  EXPECT_EQ(RolloutStatus::SUCCESS, result.status);
+  EXPECT_EQ(expected.vel_x, result.vel_x);
+  EXPECT_EQ(expected.vel_th, result.vel_th);
+  EXPECT_EQ(0u, result.evaluations);
+  EXPECT_EQ(0u, checks);
+  ASSERT_EQ(expected_trajectory.size, trajectory.size);
+  for (size_t i = 0; i < trajectory.size; ++i)
+  {
+    EXPECT_EQ(expected_trajectory.poses[i].x, trajectory.poses[i].x);
+    EXPECT_EQ(expected_trajectory.poses[i].y, trajectory.poses[i].y);
+  }
+  EXPECT_EQ(1u, cache.getHits());
+
+  // New generation: the collision checks are replayed
+  result = cache.simulate(rollout, target, limits, false, counting, 2, trajectory);
+  EXPECT_EQ(RolloutStatus::SUCCESS, result.status);
+  EXPECT_EQ(expected_trajectory.size, checks);
+
+  // An obstacle appeared: the replay finds it, and the trajectory stops there
+  CollisionChecker blocked = obstacle(0.5, 0.1, 0.1);
+  expected = rollout.simulate(target, limits, false, blocked, expected_trajectory);
+  ASSERT_EQ(RolloutStatus::COLLISION, expected.status);
+  result = cache.simulate(rollout, target, limits, false, blocked, 3, trajectory);
+  EXPECT_EQ(RolloutStatus::COLLISION, result.status);
+  EXPECT_EQ(expected_trajectory.size, trajectory.size);
+
+  // Different velocity cap or initial rotation are other keys
+  VelocityLimits slower = { 0.1, 0.4, 1.0 };
+  cache.simulate(rollout, target, slower, false, free_space, 3, trajectory);
+  cache.simulate(rollout, target, limits, true, free_space, 3, trajectory);
+  EXPECT_EQ(3u, cache.getMisses());
+  EXPECT_EQ(3u, cache.size());
+
+  // Collisions are not cached
+  Pose2D other = { 0.8, -0.2, 0.0 };
+  cache.simulate(rollout, other, limits, false, blocked, 3, trajectory);
+  EXPECT_EQ(3u, cache.size());
+
+  cache.clear();
+  EXPECT_EQ(0u, cache.size());
+  cache.simulate(rollout, target, limits, false, free_space, 3, trajectory);
+  EXPECT_EQ(5u, cache.getMisses());
+
+  // The rotation velocity limit is part of the key, only with the initial rotation
+  RolloutParameters params = defaultParameters();
+  params.max_vel_theta = 0.7;
+  GracefulRollout slow_rotation(controller, params);
+  cache.simulate(slow_rotation, target, limits, false, free_space, 3, trajectory);
+  EXPECT_EQ(5u, cache.getMisses());
+  cache.simulate(rollout, target, limits, true, free_space, 3, trajectory);
+  cache.simulate(slow_rotation, target, limits, true, free_space, 3, trajectory);
+  EXPECT_EQ(7u, cache.getMisses());
+}
+
+TEST(GracefulRolloutTests, test_rollout_cache_lazy)
+{
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0);
+  RolloutParameters params = defaultParameters();
+  params.lazy_collision_checking = true;
+  GracefulRollout rollout(controller, params);
+  RolloutCache cache(8, 2000, 2000, 0.01);
+  std::vector<Pose2D> storage(2000), expected_storage(2000);
+  std::vector<double> scalings(2000), expected_scalings(2000);
+
+  Pose2D target = { 2.0, 0.0, 0.0 };
+  VelocityLimits limits = { 0.1, 0.5, 1.0 };
+  TrajectoryBuffer trajectory(storage.data(), storage.size(), scalings.data());
+  RolloutResult result = cache.simulate(rollout, target, limits, false, obstacle(10.0, 10.0, 0.1), 1, trajectory);
+  ASSERT_EQ(RolloutStatus::SUCCESS, result.status);
+
+  // The replay stops where the lazy checks did, not at the end of the trajectory
+  CollisionChecker halfway = obstacle(1.0, 0.0, 0.1);
+  TrajectoryBuffer expected_trajectory(expected_storage.data(), expected_storage.size(), expected_scalings.data());
+  RolloutResult expected = rollout.simulate(target, limits, false, halfway, expected_trajectory);
+  ASSERT_EQ(RolloutStatus::COLLISION, expected.status);
+  result = cache.simulate(rollout, target, limits, false, halfway, 2, trajectory);
+  EXPECT_EQ(RolloutStatus::COLLISION, result.status);
+  EXPECT_EQ(expected_trajectory.size, trajectory.size);
+}
+
+TEST(GracefulRolloutTests, test_rollout_cache_eviction)
+{
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0);
+  GracefulRollout rollout(controller, defaultParameters());
+  RolloutCache cache(2, 2000, 2000, 0.01);
+  std::vector<Pose2D> storage(2000);
+  TrajectoryBuffer trajectory(storage.data(), storage.size());
+  CollisionChecker free_space = obstacle(10.0, 10.0, 0.1);
+  VelocityLimits limits = { 0.1, 0.5, 1.0 };
+
+  Pose2D a = { 1.0, 0.0, 0.0 };
+  Pose2D b = { 1.0, 0.5, 0.0 };
+  Pose2D c = { 1.0, -0.5, 0.0 };
+  cache.simulate(rollout, a, limits, false, free_space, 0, trajectory);
+  cache.simulate(rollout, b, limits, false, free_space, 0, trajectory);
+  // Use a, so that b is the least recently used
+  cache.simulate(rollout, a, limits, false, free_space, 0, trajectory);
+  cache.simulate(rollout, c, limits, false, free_space, 0, trajectory);
+  EXPECT_EQ(2u, cache.size());
+  EXPECT_EQ(1u, cache.getHits());
+  EXPECT_EQ(3u, cache.getMisses());
+
+  cache.simulate(rollout, a, limits, false, free_space, 0, trajectory);
+  cache.simulate(rollout, c, limits, false, free_space, 0, trajectory);
+  EXPECT_EQ(3u, cache.getHits());
+  cache.simulate(rollout, b, limits, false, free_space, 0, trajectory);
+  EXPECT_EQ(4u, cache.getMisses());
+
+  // Trajectories that do not fit are not cached
+  RolloutCache small(2, 5, 2000, 0.01);
+  small.simulate(rollout, a, limits, false, free_space, 0, trajectory);
+  EXPECT_EQ(0u, small.size());
+}
+
+TEST(GracefulRolloutTests, test_lazy_collision_checking)
+{
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0);
+  std::vector<Pose2D> eager_storage(2000), lazy_storage(2000);
+  std::vector<double> scalings(2000);
+
+  for (RolloutIntegrator integrator : { RolloutIntegrator::EULER, RolloutIntegrator::ARC })
+  {
+    RolloutParameters params = defaultParameters();
+    params.integrator = integrator;
+    params.footprint_radius = 0.3;
+    GracefulRollout eager(controller, params);
+    params.lazy_collision_checking = true;
+    GracefulRollout lazy(controller, params);
+
+    const CollisionChecker checkers[] = { obstacle(10.0, 10.0, 0.1), obstacle(0.8, 0.3, 0.2) };
+    size_t collisions = 0, successes = 0;
+    for (const CollisionChecker& is_colliding : checkers)
+    {
+      for (double x = -1.5; x <= 1.5; x += 0.5)
+      {
+        for (double y = -1.5; y <= 1.5; y += 0.5)
+        {
+          for (double yaw = -3.0; yaw <= 3.0; yaw += 0.75)
+          {
+            if (std::hypot(x, y) < 0.1)
+            {
+              continue;
+            }
+            Pose2D target = { x, y, yaw };
+            VelocityLimits limits = { 0.1, 0.5, 1.0 };
+            TrajectoryBuffer eager_trajectory(eager_storage.data(), eager_storage.size());
+            RolloutResult expected = eager.simulate(target, limits, false, is_colliding, eager_trajectory);
+
+            size_t checks = 0;
+            CollisionChecker counting = [&](const Pose2D& pose, double footprint_scaling)
+            {
+              ++checks;
+              return is_colliding(pose, footprint_scaling);
+            };
+            TrajectoryBuffer lazy_trajectory(lazy_storage.data(), lazy_storage.size(), scalings.data());
+            RolloutResult result = lazy.simulate(target, limits, false, counting, lazy_trajectory);
+
+            EXPECT_EQ(expected.vel_x, result.vel_x);
+            EXPECT_EQ(expected.vel_th, result.vel_th);
+            if (expected.status == RolloutStatus::SUCCESS)
+            {
+              // Same trajectory, with every pose checked once
+              EXPECT_EQ(RolloutStatus::SUCCESS, result.status);
+              ASSERT_EQ(eager_trajectory.size, lazy_trajectory.size);
+              EXPECT_EQ(lazy_trajectory.size, checks);
+              for (size_t i = 0; i < lazy_trajectory.size; ++i)
+              {
+                EXPECT_EQ(eager_trajectory.poses[i].x, lazy_trajectory.poses[i].x);
+                EXPECT_EQ(eager_trajectory.poses[i].y, lazy_trajectory.poses[i].y);
+              }
+              ++successes;
+            }
+            else
+            {
+              // A failure, but the reason may differ: a collision is only
+              // found if the trajectory converges
+              EXPECT_NE(RolloutStatus::SUCCESS, result.status);
+              collisions += (expected.status == RolloutStatus::COLLISION);
+            }
+          }
+        }
+      }
+    }
+    EXPECT_GT(successes, 0u);
+    EXPECT_GT(collisions, 0u);
+
+    // An obstacle halfway along a straight path is found after a few checks
+    CollisionChecker halfway = obstacle(1.0, 0.0, 0.1);
+    size_t eager_checks = 0, lazy_checks = 0;
+    CollisionChecker count_eager = [&](const Pose2D& pose, double footprint_scaling)
+    {
+      ++eager_checks;
+      return halfway(pose, footprint_scaling);
+    };
+    CollisionChecker count_lazy = [&](const Pose2D& pose, double footprint_scaling)
+    {
+      ++lazy_checks;
+      return halfway(pose, footprint_scaling);
+    };
+    Pose2D target = { 2.0, 0.0, 0.0 };
+    VelocityLimits limits = { 0.1, 0.5, 1.0 };
+    TrajectoryBuffer eager_trajectory(eager_storage.data(), eager_storage.size());
+    TrajectoryBuffer lazy_trajectory(lazy_storage.data(), lazy_storage.size(), scalings.data());
+    EXPECT_EQ(RolloutStatus::COLLISION, eager.simulate(target, limits, false, count_eager, eager_trajectory).status);
+    EXPECT_EQ(RolloutStatus::COLLISION, lazy.simulate(target, limits, false, count_lazy, lazy_trajectory).status);
+    EXPECT_LE(lazy_checks, 4u);
+    EXPECT_LT(lazy_checks, eager_checks);
+    EXPECT_TRUE(halfway(lazy_trajectory.poses[lazy_trajectory.size - 1], scalings[lazy_trajectory.size - 1]));
+  }
+}
+
+TEST(GracefulRolloutTests, test_bisect_caps)
+{
+  // Monotone: caps from the answer on reach the target
+  for (size_t count = 0; count <= 40; ++count)
+  {
+    size_t max_calls = 2 + static_cast<size_t>(std::ceil(std::log2(std::max<size_t>(count, 1))));
+    for (size_t answer = 0; answer <= count; ++answer)
+    {
+      std::vector<int> calls(count, 0);
+      size_t best = bisectCaps(count, 0, [&](size_t i)
+      {
+        ++calls[i];
+        return i >= answer;
+      });
+      EXPECT_EQ(answer, best);
+      size_t total = 0;
+      for (int c : calls)
+      {
+        EXPECT_LE(c, 1);
+        total += c;
+      }
+      EXPECT_LE(total, max_calls);
+    }
+  }
+
+  // Not monotone: only cap 2 and the caps from 6 on reach the target.
+  // The bisection tries 0, 9, 4, 6 and 5, verification then goes down from 3.
+  auto reaches = [](size_t i)
+  {
+    return i == 2 || i >= 6;
+  };
+  EXPECT_EQ(6u, bisectCaps(10, 0, reaches));
+  EXPECT_EQ(6u, bisectCaps(10, 1, reaches));
+  EXPECT_EQ(2u, bisectCaps(10, 2, reaches));
+  EXPECT_EQ(2u, bisectCaps(10, 10, reaches));
+
+  // Same cap as the sequential search for a footprint that only fits through an aisle when slow
+  GracefulControllerConstPtr controller =
+      std::make_shared<const GracefulController>(2.0, 1.0, 0.1, 0.5, 0.5, 1.0, 0.4, 2.0);
+  GracefulRollout rollout(controller, defaultParameters());
+  std::vector<double> caps;
+  for (double cap = 0.5; cap >= 0.1 - 1e-9; cap -= 0.025)
+  {
+    caps.push_back(cap);
+  }
+  std::vector<std::vector<Pose2D>> storage(caps.size(), std::vector<Pose2D>(2000));
+  std::vector<TrajectoryBuffer> trajectories;
+  for (std::vector<Pose2D>& poses : storage)
+  {
+    trajectories.emplace_back(poses.data(), poses.size());
+  }
+  std::vector<RolloutResult> results(caps.size());
+  Pose2D target = { 1.0, 0.3, 0.5 };
+  for (double width : { 1.5, 1.2, 1.1, 1.0, 0.5 })
+  {
+    CollisionChecker aisle = [width](const Pose2D& pose, double footprint_scaling)
+    {
+      return pose.x > 0.5 && footprint_scaling > width;
+    };
+    size_t expected = rollout.simulateCaps(target, { 0.1, 0.5, 1.0 }, caps.data(), caps.size(), false, aisle,
+                                           trajectories.data(), results.data());
+    size_t best = bisectCaps(caps.size(), 0, [&](size_t i)
+    {
+      VelocityLimits limits = { 0.1, caps[i], 1.0 };
+      return rollout.simulate(target, limits, false, aisle, trajectories[i]).status == RolloutStatus::SUCCESS;
+    });
+    EXPECT_EQ(expected, best);
+  }
+}
+
+TEST(GracefulRolloutTests, test_gallop_search)
+{
+  // Monotone: candidates from the answer on pass, few are evaluated when the answer is early
+  std::vector<char> outcomes;
+  for (size_t count = 0; count <= 100; ++count)
+  {
+    for (size_t answer = 0; answer <= count; ++answer)
+    {
+      std::vector<int> calls(count, 0);
+      bool monotone = false;
+      size_t first = gallopSearch(count, 0, [&](size_t i)
+      {
+        ++calls[i];
+        return i >= answer;
+      }, outcomes, monotone);
+      EXPECT_EQ(answer, first);
+      EXPECT_TRUE(monotone);
+      size_t total = 0;
+      for (int c : calls)
+      {
+        EXPECT_LE(c, 1);
+        total += c;
+      }
+      if (answer == 0 && count > 0)
+      {
+        // The usual case while following a path, a single call
+        EXPECT_EQ(1u, total);
+      }
+      else if (answer < count)
+      {
+        EXPECT_LE(total, 2 * static_cast<size_t>(std::ceil(std::log2(answer + 1))) + 1);
+      }
+      else
+      {
+        // Nothing passes, every candidate is tried
+        EXPECT_EQ(count, total);
+      }
+    }
+  }
+
+  // Not monotone: only candidate 5 passes, which the gallop (0, 1, 3, 7, 15, 19) skips
+  bool monotone = true;
+  EXPECT_EQ(5u, gallopSearch(20, 0, [](size_t i) { return i == 5; }, outcomes, monotone));
+  EXPECT_FALSE(monotone);
+
+  // An obstacle blocks only the middle of the path. The first candidate passes,
+  // which is the right answer: the blocked ones are not tried, and even when the
+  // check (1, 2, 4, 8) finds one, no skipped candidate passes
+  std::vector<int> calls(20, 0);
+  auto blocked_middle = [&calls](size_t i)
+  {
+    ++calls[i];
+    return i < 5 || i >= 12;
+  };
+  for (size_t verify_steps : { 0, 4 })
+  {
+    std::fill(calls.begin(), calls.end(), 0);
+    monotone = false;
+    EXPECT_EQ(0u, gallopSearch(20, verify_steps, blocked_middle, outcomes, monotone));
+    EXPECT_TRUE(monotone);
+    EXPECT_EQ(verify_steps + 1, static_cast<size_t>(std::count(calls.begin(), calls.end(), 1)));
+  }
+
+  // Only candidate 2 and those from 7 to 15 pass. The gallop (0, 1, 3, 7) and the
+  // bisection (5, 6) find 7, the check (8, 9, 11, 15, 19) fails at 19, and the
+  // skipped candidate 2 is the answer after all
+  auto detour = [&calls](size_t i)
+  {
+    ++calls[i];
+    return i == 2 || (i >= 7 && i <= 15);
+  };
+  std::fill(calls.begin(), calls.end(), 0);
+  EXPECT_EQ(7u, gallopSearch(20, 4, detour, outcomes, monotone));
+  EXPECT_TRUE(monotone);
+  std::fill(calls.begin(), calls.end(), 0);
+  EXPECT_EQ(2u, gallopSearch(20, 5, detour, outcomes, monotone));
+  EXPECT_FALSE(monotone);
+  for (int c : calls)
+  {
+    EXPECT_LE(c, 1);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
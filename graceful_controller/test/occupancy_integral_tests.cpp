@@ -0,0 +1,198 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <graceful_controller/occupancy_integral.hpp>
+
+using graceful_controller::CostGrid;
+using graceful_controller::FootprintRectangle;
+using graceful_controller::FootprintSpan;
+using graceful_controller::FootprintTemplates;
+using graceful_controller::OccupancyIntegral;
+using graceful_controller::Point2D;
+
+// Occupied cells of a rectangle, counted one by one
+static uint32_t bruteForceCount(const CostGrid& grid, unsigned char threshold, unsigned int x_begin,
+                                unsigned int y_begin, unsigned int x_end, unsigned int y_end)
+{
+  uint32_t count = 0;
+  for (unsigned int y = y_begin; y < y_end; ++y)
+  {
+    for (unsigned int x = x_begin; x < x_end; ++x)
+    {
+      count += grid.getCost(x, y) >= threshold;
+    }
+  }
+  return count;
+}
+
+TEST(OccupancyIntegralTests, test_incremental_update)
+{
+  std::vector<unsigned char> costs(37 * 23, 0);
+  CostGrid grid = { costs.data(), 37, 23, 0.05, 0.0, 0.0 };
+  OccupancyIntegral integral(graceful_controller::INSCRIBED_COST);
+  EXPECT_EQ(graceful_controller::INSCRIBED_COST, integral.getThreshold());
+
+  std::mt19937 random(42);
+  std::uniform_int_distribution<int> cost(0, 255);
+  for (unsigned char& cell : costs)
+  {
+    cell = cost(random);
+  }
+  EXPECT_EQ(37u * 23u, integral.update(grid));
+
+  std::uniform_int_distribution<unsigned int> column(0, 36), row(0, 22);
+  for (int round = 0; round < 50; ++round)
+  {
+    // Every rectangle, including empty ones, counts the same as cell by cell
+    for (int query = 0; query < 50; ++query)
+    {
+      unsigned int x0 = column(random), x1 = column(random), y0 = row(random), y1 = row(random);
+      unsigned int x_begin = std::min(x0, x1), x_end = std::max(x0, x1) + (query % 2);
+      unsigned int y_begin = std::min(y0, y1), y_end = std::max(y0, y1) + (query % 2);
+      EXPECT_EQ(bruteForceCount(grid, integral.getThreshold(), x_begin, y_begin, x_end, y_end),
+                integral.count(x_begin, y_begin, x_end, y_end));
+    }
+
+    // Nothing changed, nothing to do
+    EXPECT_EQ(0u, integral.update(grid));
+
+    // Cells that stay on the same side of the threshold do not count as changed
+    unsigned int x = column(random), y = row(random);
+    costs[y * 37 + x] = costs[y * 37 + x] >= graceful_controller::INSCRIBED_COST ? 255 : 0;
+    EXPECT_EQ(0u, integral.update(grid));
+
+    // A few cells flip, only entries after the first of them are recomputed
+    unsigned int min_x = 37, min_y = 23;
+    std::vector<bool> flipped(costs.size(), false);
+    for (int flip = 0; flip <= round % 3; ++flip)
+    {
+      do
+      {
+        x = column(random);
+        y = row(random);
+      } while (flipped[y * 37 + x]);
+      flipped[y * 37 + x] = true;
+      costs[y * 37 + x] = costs[y * 37 + x] >= graceful_controller::INSCRIBED_COST ? 0 : 254;
+      min_x = std::min(min_x, x);
+      min_y = std::min(min_y, y);
+    }
+    EXPECT_EQ((37u - min_x) * (23u - min_y), integral.update(grid));
+  }
+
+  // A new size starts over
+  std::vector<unsigned char> larger(40 * 30, graceful_controller::LETHAL_COST);
+  grid = { larger.data(), 40, 30, 0.05, 0.0, 0.0 };
+  EXPECT_EQ(40u * 30u, integral.update(grid));
+  EXPECT_EQ(40u * 30u, integral.count(0, 0, 40, 30));
+}
+
+TEST(OccupancyIntegralTests, test_rectangles)
+{
+  std::vector<Point2D> footprint = { { 0.3, 0.2 }, { 0.3, -0.2 }, { -0.3, -0.2 }, { -0.3, 0.2 } };
+  FootprintTemplates templates(footprint, 0.05, 32, 1.5, 0.25, true, 3);
+  for (double yaw = -M_PI; yaw < M_PI; yaw += 0.05)
+  {
+    for (double scaling : { 1.0, 1.2, 1.5 })
+    {
+      size_t span_count, rectangle_count;
+      const FootprintSpan* spans = templates.getSpans(yaw, scaling, span_count);
+      const FootprintRectangle* rectangles = templates.getRectangles(yaw, scaling, rectangle_count);
+      EXPECT_GE(rectangle_count, 1u);
+      EXPECT_LE(rectangle_count, 3u);
+
+      // Every cell of the filled template is in a rectangle
+      size_t template_cells = 0;
+      for (size_t i = 0; i < span_count; ++i)
+      {
+        for (int x = spans[i].x_begin; x < spans[i].x_end; ++x)
+        {
+          bool covered = false;
+          for (size_t j = 0; j < rectangle_count; ++j)
+          {
+            covered |= x >= rectangles[j].x_begin && x < rectangles[j].x_end && spans[i].dy >= rectangles[j].y_begin &&
+                       spans[i].dy < rectangles[j].y_end;
+          }
+          EXPECT_TRUE(covered) << "yaw " << yaw << ", scaling " << scaling;
+          ++template_cells;
+        }
+      }
+
+      // Without much else, a rotated rectangle fits in 3 rectangles with less than half again as many cells
+      size_t rectangle_cells = 0;
+      for (size_t j = 0; j < rectangle_count; ++j)
+      {
+        rectangle_cells += (rectangles[j].x_end - rectangles[j].x_begin) * (rectangles[j].y_end - rectangles[j].y_begin);
+      }
+      EXPECT_LT(rectangle_cells, template_cells * 3 / 2) << "yaw " << yaw << ", scaling " << scaling;
+    }
+  }
+}
+
+TEST(OccupancyIntegralTests, test_colliding)
+{
+  std::vector<unsigned char> costs(100 * 100, 0);
+  CostGrid grid = { costs.data(), 100, 100, 0.05, -2.5, -2.5 };
+  std::vector<Point2D> footprint = { { 0.3, 0.2 }, { 0.3, -0.2 }, { -0.3, -0.2 }, { -0.3, 0.2 } };
+  FootprintTemplates templates(footprint, grid.resolution, 64, 1.0, 0.0, true);
+  OccupancyIntegral integral;
+
+  // Free, then off the grid
+  integral.update(grid);
+  EXPECT_FALSE(integral.isColliding(templates, 0.0, 0.0, 0.5, 1.0));
+  EXPECT_TRUE(integral.isColliding(templates, 2.4, 0.0, 0.5, 1.0));
+  EXPECT_TRUE(integral.isColliding(templates, -3.0, 0.0, 0.5, 1.0));
+
+  // Whatever the filled templates catch, the rectangles catch too
+  std::mt19937 random(42);
+  std::uniform_int_distribution<unsigned int> cell(30, 69);
+  std::uniform_real_distribution<double> heading(-M_PI, M_PI);
+  size_t caught = 0;
+  for (int trial = 0; trial < 500; ++trial)
+  {
+    unsigned int x = cell(random), y = cell(random);
+    costs[y * 100 + x] = graceful_controller::LETHAL_COST;
+    integral.update(grid);
+    double yaw = heading(random);
+    if (templates.isColliding(grid, 0.01, 0.02, yaw, 1.0))
+    {
+      EXPECT_TRUE(integral.isColliding(templates, 0.01, 0.02, yaw, 1.0)) << "trial " << trial;
+      ++caught;
+    }
+    costs[y * 100 + x] = 0;
+  }
+  EXPECT_GT(caught, 50u);
+
+  // Far away obstacles are not caught
+  costs[5 * 100 + 5] = graceful_controller::LETHAL_COST;
+  integral.update(grid);
+  EXPECT_FALSE(integral.isColliding(templates, 0.0, 0.0, 0.5, 1.0));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2021-2022 Michael Ferguson
+ * Copyright 2015 Fetch Robotics Inc
+ * Author: Michael Ferguson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <graceful_controller/thread_pool.hpp>
+
+using graceful_controller::ThreadPool;
+using graceful_controller::findFirstSuccess;
+
+TEST(ThreadPoolTests, test_run)
+{
+  ThreadPool pool(4, { 0 });
+  EXPECT_EQ(4u, pool.size());
+
+  // Every index runs exactly once, on a valid worker, batch after batch
+  for (size_t count : { 0, 1, 3, 100, 1000 })
+  {
+    std::vector<std::atomic<int>> runs(count);
+    std::atomic<bool> bad_worker(false);
+    pool.run(count, [&](size_t index, size_t worker)
+    {
+      ++runs[index];
+      if (worker >= 4)
+      {
+        bad_worker = true;
+      }
+    });
+    for (size_t i = 0; i < count; ++i)
+    {
+      EXPECT_EQ(1, runs[i].load());
+    }
+    EXPECT_FALSE(bad_worker);
+  }
+}
+
+TEST(ThreadPoolTests, test_stealing)
+{
+  ThreadPool pool(2);
+
+  // Index 0 holds its worker until all others are done. That worker was dealt
+  // half of them, so they only finish if the other worker steals them.
+  std::atomic<int> done(0);
+  bool all_done = false;
+  pool.run(10, [&](size_t index, size_t)
+  {
+    if (index == 0)
+    {
+      auto start = std::chrono::steady_clock::now();
+      while (done.load() < 9 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+      {
+        std::this_thread::yield();
+      }
+      all_done = done.load() == 9;
+    }
+    else
+    {
+      ++done;
+    }
+  });
+  EXPECT_TRUE(all_done);
+}
+
+TEST(ThreadPoolTests, test_find_first_success)
+{
+  ThreadPool pool(4);
+
+  for (size_t answer : { 0, 1, 7, 31, 64 })
+  {
+    // Candidates at and after the answer pass, the later ones are quicker,
+    // so that they usually pass before the answer is evaluated
+    std::vector<std::atomic<int>> evaluated(64);
+    size_t first = findFirstSuccess(pool, 64, [&](size_t candidate, size_t, const std::atomic<size_t>&)
+    {
+      ++evaluated[candidate];
+      std::this_thread::sleep_for(std::chrono::microseconds(64 - candidate));
+      return candidate >= answer;
+    });
+    EXPECT_EQ(answer, first);
+    for (size_t i = 0; i < answer && i < 64; ++i)
+    {
+      EXPECT_EQ(1, evaluated[i].load());
+    }
+  }
+
+  // Later candidates give up once an earlier one passed, instead of running for 5s
+  auto start = std::chrono::steady_clock::now();
+  size_t first = findFirstSuccess(pool, 8, [&](size_t candidate, size_t, const std::atomic<size_t>& best)
+  {
+    if (candidate == 0)
+    {
+      return true;
+    }
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+    {
+      if (best.load() < candidate)
+      {
+        return false;
+      }
+    }
+    return true;
+  });
+  EXPECT_EQ(0u, first);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
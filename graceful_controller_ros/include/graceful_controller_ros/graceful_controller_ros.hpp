@@ -39,6 +39,9 @@
 #ifndef GRACEFUL_CONTROLLER_ROS_GRACEFUL_CONTROLLER_ROS_HPP
 #define GRACEFUL_CONTROLLER_ROS_GRACEFUL_CONTROLLER_ROS_HPP
 
+#include <atomic>
+#include <future>
+#include <memory>
 #include <mutex>
 
 #include <nav_core/base_local_planner.h>
@@ -46,7 +49,14 @@
 
 #include <base_local_planner/local_planner_util.h>
 #include <base_local_planner/odometry_helper_ros.h>
+#include <graceful_controller/cost_pyramid.hpp>
+#include <graceful_controller/curvature_table.hpp>
+#include <graceful_controller/footprint_templates.hpp>
 #include <graceful_controller/graceful_controller.hpp>
+#include <graceful_controller/graceful_rollout.hpp>
+#include <graceful_controller/occupancy_integral.hpp>
+#include <graceful_controller/rollout_cache.hpp>
+#include <graceful_controller/thread_pool.hpp>
 #include <graceful_controller_ros/orientation_tools.hpp>
 #include <std_msgs/Float32.h>
 #include <tf2/utils.h>
@@ -115,26 +125,100 @@ public:
    */
   void rotateTowards(double yaw, geometry_msgs::Twist& cmd_vel);
 
+  /**
+   * @brief Get the memory reserved for storage that is reused by every
+   *        call to computeVelocityCommands(), in bytes. Once the plan and
+   *        parameters stop changing, this should stop growing. For tests.
+   */
+  size_t getBufferCapacity() const;
+
 private:
   void velocityCallback(const std_msgs::Float32::ConstPtr& max_vel_x);
 
   /**
-   * @brief Simulate a path.
-   * @param target_pose Pose to simulate towards.
+   * @brief Get the maximum in place rotation velocity, based on current speed.
+   */
+  double getMaxRotationVelocity();
+
+  // Storage for the rollouts of one target pose, trajectory_capacity_ poses per velocity cap
+  struct RolloutStorage
+  {
+    std::vector<Pose2D> poses;
+    std::vector<double> footprint_scalings;  // only with lazy_collision_checking
+    std::vector<TrajectoryBuffer> trajectories;
+    std::vector<RolloutResult> results;
+  };
+
+  /**
+   * @brief Simulate a path once per velocity cap, see GracefulRollout::simulateCaps(),
+   *        or only some of them with velocity_bisection, see bisectCaps().
+   *        Without the rollout cache, this can run on several threads with separate storage.
+   * @param target Pose to simulate towards, relative to robot base link.
+   * @param limits Velocity limits for the control law, except for max_abs_velocity.
+   * @param max_velocities Maximum linear velocity of each simulation, fastest first.
+   * @param count Number of max_velocities.
+   * @param storage Where the rollouts go, large enough for count caps.
+   * @returns Index of the fastest cap that reached the target, or count if none did.
+   */
+  size_t simulate(const GracefulRollout& rollout, const Pose2D& target, const VelocityLimits& limits,
+                  const double* max_velocities, size_t count, bool initial_rotation,
+                  const CollisionChecker& is_colliding, RolloutStorage& storage);
+
+  /**
+   * @brief Report the rollouts of a target pose, and keep the winner (or the slowest
+   *        cap, if no rollout reached the target) for publishRollout().
+   * @param storage Index into rollout_storage_ of the rollouts.
+   * @param first_cap Index into velocity_caps_ of the first rollout.
+   * @param best Index of the fastest rollout that reached the target, as returned by simulate().
    * @param cmd_vel The returned command to execute.
-   * @returns True if the path is valid.
+   * @returns True if a rollout reached the target.
+   */
+  bool useRollout(const Pose2D& target, const VelocityLimits& limits, bool initial_rotation,
+                  size_t storage, size_t first_cap, size_t best, geometry_msgs::Twist& cmd_vel);
+
+  /**
+   * @brief Grow storage to hold count rollouts, and their footprint scalings
+   *        once lazy_collision_checking is used.
+   */
+  void reserveStorage(RolloutStorage& storage, size_t count);
+
+  /**
+   * @brief Copy the footprint of the costmap, if it changed since the last cycle,
+   *        and rebuild the footprint templates in the background when they no
+   *        longer match it. Outdated templates are dropped right away.
+   */
+  void updateFootprint();
+
+  /**
+   * @brief Log the work of the search of this cycle, to compare search strategies.
    */
-  bool simulate(const geometry_msgs::PoseStamped& target_pose, geometry_msgs::Twist& cmd_vel);
+  void reportSearch(bool success) const;
+
+  /**
+   * @brief Publish the winning rollout of the last call to simulate(). Messages
+   *        are only built for the topics that have subscribers.
+   * @param success Whether the rollout reached its target. Otherwise only the
+   *        collision points are published, to show why it did not.
+   * @param is_colliding The collision checks of the search, which the collision
+   *        points show the rejected pose of.
+   */
+  void publishRollout(bool success, const CollisionChecker& is_colliding);
 
   ros::Publisher global_plan_pub_, local_plan_pub_, target_pose_pub_;
   ros::Subscriber max_vel_sub_;
 
   bool initialized_;
-  GracefulControllerPtr controller_;
+  GracefulControllerConstPtr controller_;
+
+  // Curvature table of the control law, built in the background. The exact
+  // (or fast math) controller is used until the pending table is ready.
+  CurvatureTablePtr curvature_table_;
+  double curvature_table_resolution_;  // as requested, the table rounds it to fit [-pi, pi]
+  std::future<CurvatureTablePtr> pending_curvature_table_;
 
   tf2_ros::Buffer* buffer_;
   costmap_2d::Costmap2DROS* costmap_ros_;
-  geometry_msgs::TransformStamped robot_to_costmap_transform_;
+  Transform2D robot_to_costmap_;
   base_local_planner::LocalPlannerUtil planner_util_;
   base_local_planner::OdometryHelperRos odom_helper_;
 
@@ -153,6 +237,8 @@ private:
   double scaling_vel_x_;
   double scaling_factor_;
   double scaling_step_;
+  bool velocity_bisection_;
+  size_t bisection_verify_steps_;
   double xy_goal_tolerance_;
   double yaw_goal_tolerance_;
   double xy_vel_goal_tolerance_;
@@ -164,6 +250,17 @@ private:
   double yaw_filter_tolerance_;
   double yaw_gap_tolerance_;
   bool prefer_final_rotation_;
+  bool target_galloping_;
+  size_t target_galloping_verify_steps_;
+  bool arc_integration_;
+  double max_step_length_;
+  double max_heading_error_;
+  bool incremental_rotation_;
+  bool lazy_collision_checking_;
+  size_t footprint_yaw_bins_;
+  double footprint_scaling_resolution_;
+  bool footprint_filled_;
+  bool footprint_integral_;
   bool compute_orientations_;
   bool use_orientation_filter_;
 
@@ -180,6 +277,69 @@ private:
   visualization_msgs::MarkerArray* collision_points_;
 
   geometry_msgs::PoseStamped robot_pose_;
+
+  // Storage for each control cycle, cleared (but not freed) at the start of the cycle
+  std::vector<geometry_msgs::PoseStamped> transformed_plan_;
+  std::vector<Pose2D> target_poses_;
+  std::vector<double> target_distances_;
+  std::vector<double> velocity_caps_;
+  std::vector<geometry_msgs::PoseStamped> simulated_path_;
+
+  // Footprint of the costmap (centered around robot) that collision checks use
+  std::vector<geometry_msgs::Point> footprint_;
+
+  // Optional templates of footprint_ for the rollouts, rebuilt in the background by
+  // updateFootprint(). The polygon is checked until the pending templates are ready.
+  std::unique_ptr<FootprintTemplates> footprint_templates_;
+  std::future<std::unique_ptr<FootprintTemplates>> pending_footprint_templates_;
+
+  // Optional summed area table of the lethal cells of the costmap, updated each cycle
+  OccupancyIntegral occupancy_integral_;
+
+  // Optional max cost pyramid of the costmap, updated each cycle
+  std::unique_ptr<CostPyramid> cost_pyramid_;
+
+  // Storage for the rollouts: the first for the calling thread, then two per worker,
+  // and a spare one for the galloping search
+  size_t trajectory_capacity_;
+  std::vector<RolloutStorage> rollout_storage_;
+  std::vector<int> candidates_;
+  std::vector<char> gallop_outcomes_;  // scratch of gallopSearch()
+
+  // Optional cache of rollouts across control cycles, valid for rollout_cache_params_
+  std::unique_ptr<RolloutCache> rollout_cache_;
+  RolloutParameters rollout_cache_params_;
+  uint64_t control_cycle_;
+
+  // Distance along the plan of the target and index of the velocity cap that
+  // last worked, the search of the next cycle starts there
+  bool has_warm_start_;
+  double warm_start_distance_;
+  size_t warm_start_cap_;
+
+  // Whether the galloping search may assume that, once a target pose of the path
+  // is reachable, so are all closer ones. Cleared for the rest of a path once the
+  // search found a target pose that the gallop and the bisection had skipped.
+  bool targets_monotone_;
+
+  // Work of the search of the current cycle, updated by simulate()
+  std::atomic<size_t> search_targets_;
+  std::atomic<size_t> search_rollouts_;
+  std::atomic<size_t> search_evaluations_;
+
+  // Winning rollout of the last target pose simulated, in rollout_storage_[rollout_storage_index_]
+  RolloutParameters rollout_params_;
+  Pose2D rollout_target_;
+  VelocityLimits rollout_limits_;
+  bool rollout_initial_rotation_;
+  size_t rollout_storage_index_;
+  size_t rollout_index_;
+
+  // Optional parallel search, with the best candidate of each worker and where it is stored
+  std::unique_ptr<ThreadPool> thread_pool_;
+  std::vector<size_t> worker_best_;
+  std::vector<size_t> worker_storage_;
+  std::vector<size_t> worker_best_cap_;
 };
 
 /**
@@ -191,6 +351,11 @@ private:
 void computeDistanceAlongPath(const std::vector<geometry_msgs::PoseStamped>& poses,
                               std::vector<double>& distances);
 
+/**
+ * @brief Same as above, for planar poses.
+ */
+void computeDistanceAlongPath(const std::vector<Pose2D>& poses, std::vector<double>& distances);
+
 }  // namespace graceful_controller
 
 #endif  // GRACEFUL_CONTROLLER_ROS_GRACEFUL_CONTROLLER_ROS_HPP
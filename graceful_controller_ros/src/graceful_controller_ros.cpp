@@ -36,13 +36,18 @@
  * Author: Eitan Marder-Eppstein, Michael Ferguson
  *********************************************************************/
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <limits>
 
 #include <angles/angles.h>
 #include <base_local_planner/goal_functions.h>
 #include <base_local_planner/line_iterator.h>
-#include <costmap_2d/footprint.h>
 #include <graceful_controller/graceful_controller.hpp>
+#include <graceful_controller/graceful_rollout.hpp>
 #include <graceful_controller_ros/orientation_tools.hpp>
 #include <std_msgs/Float32.h>
 
@@ -55,15 +60,40 @@ double sign(double x)
   return x < 0.0 ? -1.0 : 1.0;
 }
 
+/**
+ * @brief Whether two sets of control law parameters give the same curvature table
+ */
+bool sameParameters(const ControlLawParameters& a, const ControlLawParameters& b)
+{
+  return a.k1 == b.k1 && a.k2 == b.k2 && a.max_decel == b.max_decel && a.beta == b.beta && a.lambda == b.lambda;
+}
+
+/**
+ * @brief Whether two sets of rollout parameters simulate the same trajectories. The
+ *        max_vel_theta follows the odometry, the rollout cache keys it instead.
+ */
+bool sameParameters(const RolloutParameters& a, const RolloutParameters& b)
+{
+  return a.resolution == b.resolution && a.initial_rotate_tolerance == b.initial_rotate_tolerance &&
+         a.min_in_place_vel_theta == b.min_in_place_vel_theta &&
+         a.acc_lim_theta == b.acc_lim_theta && a.max_vel_x == b.max_vel_x && a.scaling_vel_x == b.scaling_vel_x &&
+         a.scaling_factor == b.scaling_factor && a.integrator == b.integrator &&
+         a.max_step_length == b.max_step_length && a.max_heading_error == b.max_heading_error &&
+         a.footprint_radius == b.footprint_radius && a.incremental_rotation == b.incremental_rotation &&
+         a.lazy_collision_checking == b.lazy_collision_checking;
+}
+
 /**
  * @brief Collision check the robot pose
  * @param x The robot x coordinate in costmap.global frame
  * @param y The robot y coordinate in costmap.global frame
  * @param theta The robot rotation in costmap.global frame
+ * @param footprint_spec The footprint of the costmap (centered around robot)
  * @param viz Optional message for visualizing collisions
  * @param inflation Ratio to expand the footprint
  */
 bool isColliding(double x, double y, double theta, costmap_2d::Costmap2DROS* costmap,
+                 const std::vector<geometry_msgs::Point>& footprint_spec,
                  visualization_msgs::MarkerArray* viz, double inflation = 1.0)
 {
   unsigned mx, my;
@@ -80,20 +110,21 @@ bool isColliding(double x, double y, double theta, costmap_2d::Costmap2DROS* cos
     inflation = 1.0;
   }
 
-  // Get footprint (centered around robot)
-  std::vector<geometry_msgs::Point> spec = costmap->getRobotFootprint();
-
-  // Expand footprint by desired infation
-  for (size_t i = 0; i < spec.size(); ++i)
+  // Expand footprint by desired inflation and transform it to robot pose, the
+  // same as costmap_2d::transformFootprint(), into a buffer that each thread
+  // reuses so that collision checks do not allocate
+  thread_local std::vector<geometry_msgs::Point> footprint;
+  footprint.resize(footprint_spec.size());
+  double cos_th = cos(theta);
+  double sin_th = sin(theta);
+  for (size_t i = 0; i < footprint_spec.size(); ++i)
   {
-    spec[i].x *= inflation;
-    spec[i].y *= inflation;
+    double spec_x = footprint_spec[i].x * inflation;
+    double spec_y = footprint_spec[i].y * inflation;
+    footprint[i].x = x + (spec_x * cos_th - spec_y * sin_th);
+    footprint[i].y = y + (spec_x * sin_th + spec_y * cos_th);
   }
 
-  // Transform footprint to robot pose
-  std::vector<geometry_msgs::Point> footprint;
-  costmap_2d::transformFootprint(x, y, theta, spec, footprint);
-
   // If our footprint is less than 4 corners, treat as circle
   if (footprint.size() < 4)
   {
@@ -142,7 +173,12 @@ bool isColliding(double x, double y, double theta, costmap_2d::Costmap2DROS* cos
   return false;
 }
 
-GracefulControllerROS::GracefulControllerROS() : initialized_(false), has_new_path_(false), collision_points_(NULL)
+GracefulControllerROS::GracefulControllerROS()
+  : initialized_(false), curvature_table_resolution_(0.0), has_new_path_(false), collision_points_(NULL),
+    trajectory_capacity_(0), rollout_initial_rotation_(false), rollout_storage_index_(0), rollout_index_(0),
+    control_cycle_(0),
+    has_warm_start_(false), warm_start_distance_(0.0), warm_start_cap_(0), targets_monotone_(true),
+    search_targets_(0), search_rollouts_(0), search_evaluations_(0)
 {
 }
 
@@ -184,6 +220,21 @@ void GracefulControllerROS::initialize(std::string name, tf2_ros::Buffer* tf, co
       collision_points_ = new visualization_msgs::MarkerArray();
     }
 
+    // Optionally simulate several target poses at once
+    int parallel_workers = 0;
+    private_nh.getParam("parallel_workers", parallel_workers);
+    if (parallel_workers > 0)
+    {
+      std::vector<int> parallel_cpus;
+      private_nh.getParam("parallel_cpus", parallel_cpus);
+      thread_pool_.reset(new ThreadPool(parallel_workers, parallel_cpus));
+      worker_best_.resize(parallel_workers);
+      worker_storage_.resize(parallel_workers);
+      worker_best_cap_.resize(parallel_workers);
+    }
+    // One storage for the calling thread, two per worker, and a spare one
+    rollout_storage_.resize(2 + 2 * std::max(0, parallel_workers));
+
     std::string odom_topic;
     if (private_nh.getParam("odom_topic", odom_topic))
     {
@@ -216,6 +267,9 @@ void GracefulControllerROS::initialize(std::string name, tf2_ros::Buffer* tf, co
 
 void GracefulControllerROS::reconfigureCallback(GracefulControllerConfig& config, uint32_t level)
 {
+  // A build in progress may be outdated, it is waited for once the lock is released
+  std::future<CurvatureTablePtr> outdated_curvature_table;
+
   // Lock the mutex
   std::lock_guard<std::mutex> lock(config_mutex_);
 
@@ -255,6 +309,17 @@ void GracefulControllerROS::reconfigureCallback(GracefulControllerConfig& config
   max_lookahead_ = config.max_lookahead;
   initial_rotate_tolerance_ = config.initial_rotate_tolerance;
   prefer_final_rotation_ = config.prefer_final_rotation;
+  target_galloping_ = config.target_galloping;
+  target_galloping_verify_steps_ = config.target_galloping_verify_steps;
+  arc_integration_ = config.arc_integration;
+  max_step_length_ = config.max_step_length;
+  max_heading_error_ = config.max_heading_error;
+  incremental_rotation_ = config.incremental_rotation;
+  lazy_collision_checking_ = config.lazy_collision_checking;
+  footprint_yaw_bins_ = config.footprint_yaw_bins;
+  footprint_scaling_resolution_ = config.footprint_scaling_resolution;
+  footprint_filled_ = config.footprint_filled;
+  footprint_integral_ = config.footprint_integral;
   compute_orientations_ = config.compute_orientations;
   use_orientation_filter_ = config.use_orientation_filter;
   yaw_filter_tolerance_ = config.yaw_filter_tolerance;
@@ -262,6 +327,35 @@ void GracefulControllerROS::reconfigureCallback(GracefulControllerConfig& config
   latch_xy_goal_tolerance_ = config.latch_xy_goal_tolerance;
   resolution_ = planner_util_.getCostmap()->getResolution();
 
+  // Storage for rollouts, long enough to cross the costmap several times.
+  // Anything longer is circling and will never reach the target.
+  costmap_2d::Costmap2D* costmap = planner_util_.getCostmap();
+  trajectory_capacity_ = 4 * (costmap->getSizeInCellsX() + costmap->getSizeInCellsY()) + 1000;
+  for (RolloutStorage& storage : rollout_storage_)
+  {
+    storage.poses.clear();
+    storage.trajectories.clear();
+  }
+
+  // Cached rollouts are only long enough for Euler integration to check each pose once,
+  // arc rollouts with more collision checks than that are simulated every time
+  rollout_cache_.reset();
+  if (config.rollout_cache_size > 0)
+  {
+    rollout_cache_.reset(new RolloutCache(config.rollout_cache_size, trajectory_capacity_, trajectory_capacity_,
+                                          config.rollout_cache_resolution));
+  }
+
+  // Pyramid of the costmap for fast acceptance of collision checks in open space
+  if (config.cost_pyramid_levels == 0)
+  {
+    cost_pyramid_.reset();
+  }
+  else if (!cost_pyramid_ || cost_pyramid_->getLevels() != static_cast<size_t>(config.cost_pyramid_levels))
+  {
+    cost_pyramid_.reset(new CostPyramid(config.cost_pyramid_levels));
+  }
+
   if (decel_lim_x_ < 0.001)
   {
     // If decel limit not specified, use accel limit
@@ -279,13 +373,47 @@ void GracefulControllerROS::reconfigureCallback(GracefulControllerConfig& config
   max_vel_theta_limited_ = max_vel_x_ * max_x_to_max_theta_scale_factor_;
   max_vel_theta_limited_ = std::min(max_vel_theta_limited_, max_vel_theta_);
 
+  // The controller is immutable once created, and is replaced (rather than
+  // modified) on reconfigure so that it can be shared without locking
+  MathBackend math_backend = config.fast_math ? MathBackend::APPROXIMATE : MathBackend::EXACT;
   controller_ =
-      std::make_shared<GracefulController>(config.k1, config.k2, config.min_vel_x, config.max_vel_x, decel_lim_x_,
-                                           config.max_vel_theta, config.beta, config.lambda);
+      std::make_shared<const GracefulController>(config.k1, config.k2, config.min_vel_x, config.max_vel_x, decel_lim_x_,
+                                           config.max_vel_theta, config.beta, config.lambda, math_backend);
+
+  // Any build in progress may be outdated
+  outdated_curvature_table = std::move(pending_curvature_table_);
+  pending_curvature_table_ = std::future<CurvatureTablePtr>();
+  if (config.lookup_table)
+  {
+    ControlLawParameters params = controller_->getParameters();
+    if (curvature_table_ && sameParameters(curvature_table_->getParameters(), params) &&
+        curvature_table_resolution_ == config.lookup_table_resolution)
+    {
+      // Only the velocity limits changed, the table is still valid
+      controller_ = std::make_shared<const GracefulController>(curvature_table_, controller_->getVelocityLimits());
+    }
+    else
+    {
+      // Building a fine table takes a while, do not block reconfigure
+      double resolution = config.lookup_table_resolution;
+      curvature_table_.reset();
+      curvature_table_resolution_ = resolution;
+      pending_curvature_table_ = std::async(std::launch::async, [params, resolution]()
+      {
+        return std::make_shared<const CurvatureTable>(params, resolution);
+      });
+    }
+  }
+  else
+  {
+    curvature_table_.reset();
+  }
 
   scaling_vel_x_ = std::max(config.scaling_vel_x, config.min_vel_x);
   scaling_factor_ = config.scaling_factor;
   scaling_step_ = config.scaling_step;
+  velocity_bisection_ = config.velocity_bisection;
+  bisection_verify_steps_ = config.bisection_verify_steps;
 }
 
 bool GracefulControllerROS::computeVelocityCommands(geometry_msgs::Twist& cmd_vel)
@@ -301,20 +429,45 @@ bool GracefulControllerROS::computeVelocityCommands(geometry_msgs::Twist& cmd_ve
   // Lock the mutex
   std::lock_guard<std::mutex> lock(config_mutex_);
 
+  if (pending_curvature_table_.valid() &&
+      pending_curvature_table_.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+  {
+    // Switch to the curvature table once it has been built
+    curvature_table_ = pending_curvature_table_.get();
+    controller_ = std::make_shared<const GracefulController>(curvature_table_, controller_->getVelocityLimits());
+    if (rollout_cache_)
+    {
+      rollout_cache_->clear();
+    }
+    ROS_INFO("Using a curvature table with resolution %.4f rad (%zu bytes), curvature error is at most %.2e / r",
+             curvature_table_->getResolution(), curvature_table_->getSizeInBytes(), curvature_table_->getMaxError());
+  }
+
+  updateFootprint();
+
   if (!costmap_ros_->getRobotPose(robot_pose_))
   {
     ROS_ERROR("Could not get the robot pose");
     return false;
   }
 
-  std::vector<geometry_msgs::PoseStamped> transformed_plan;
+  // The costmap does not tell when it was updated, so each cycle is a new
+  // generation for the rollout cache, and its collision checks are replayed
+  ++control_cycle_;
+
+  // Per-cycle storage is reused, so that the plan and rollout buffers keep their capacity
+  // from one cycle to the next (tf, the planner utilities and publishing still allocate)
+  std::vector<geometry_msgs::PoseStamped>& transformed_plan = transformed_plan_;
   if (!planner_util_.getLocalPlan(robot_pose_, transformed_plan))
   {
     ROS_ERROR("Could not get local plan");
     return false;
   }
 
-  base_local_planner::publishPlan(transformed_plan, global_plan_pub_);
+  if (global_plan_pub_.getNumSubscribers() > 0)
+  {
+    base_local_planner::publishPlan(transformed_plan, global_plan_pub_);
+  }
 
   if (transformed_plan.empty())
   {
@@ -328,10 +481,6 @@ bool GracefulControllerROS::computeVelocityCommands(geometry_msgs::Twist& cmd_ve
   {
     costmap_to_robot = buffer_->lookupTransform(costmap_ros_->getBaseFrameID(), costmap_ros_->getGlobalFrameID(),
                                                 ros::Time(), ros::Duration(0.5));
-    tf2::Stamped<tf2::Transform> tf2_transform;
-    tf2::convert(costmap_to_robot, tf2_transform);
-    tf2_transform.setData(tf2_transform.inverse());
-    robot_to_costmap_transform_ = tf2::toMsg(tf2_transform);
   }
   catch (tf2::TransformException& ex)
   {
@@ -339,6 +488,11 @@ bool GracefulControllerROS::computeVelocityCommands(geometry_msgs::Twist& cmd_ve
     return false;
   }
 
+  // Planar transforms for the rollouts, so that they need no messages or quaternions
+  Transform2D costmap_to_robot_2d(costmap_to_robot.transform.translation.x, costmap_to_robot.transform.translation.y,
+                                  tf2::getYaw(costmap_to_robot.transform.rotation));
+  robot_to_costmap_ = costmap_to_robot_2d.inverse();
+
   // Get the overall goal
   geometry_msgs::PoseStamped goal_pose;
   if (!planner_util_.getGoal(goal_pose))
@@ -387,18 +541,25 @@ bool GracefulControllerROS::computeVelocityCommands(geometry_msgs::Twist& cmd_ve
     {
       num_steps = 1;
     }
+    // Only visualize the collision check if someone is listening
+    visualization_msgs::MarkerArray* viz = NULL;
+    if (collision_points_ && collision_point_pub_.getNumSubscribers() > 0)
+    {
+      viz = collision_points_;
+      viz->markers.resize(0);
+    }
     // If we fail to generate an in place rotation, maybe we need to move along path a bit more
     bool collision_free = true;
     for (size_t i = 1; i <= num_steps; ++i)
     {
       double step = static_cast<double>(i) / static_cast<double>(num_steps);
       double yaw = yaw_start + (step * (yaw_start - yaw_end));
-      if (isColliding(robot_pose_.pose.position.x, robot_pose_.pose.position.y, yaw, costmap_ros_, collision_points_))
+      if (isColliding(robot_pose_.pose.position.x, robot_pose_.pose.position.y, yaw, costmap_ros_, footprint_, viz))
       {
         ROS_WARN("Unable to rotate in place due to collision.");
-        if (collision_points_)
+        if (viz)
         {
-          collision_point_pub_.publish(*collision_points_);
+          collision_point_pub_.publish(*viz);
         }
         collision_free = false;
         break;
@@ -434,211 +595,680 @@ bool GracefulControllerROS::computeVelocityCommands(geometry_msgs::Twist& cmd_ve
   }
 
   // Compute distance along path
-  std::vector<geometry_msgs::PoseStamped> target_poses;
-  std::vector<double> target_distances;
-  for (auto pose : transformed_plan)
+  std::vector<Pose2D>& target_poses = target_poses_;
+  std::vector<double>& target_distances = target_distances_;
+  target_poses.clear();
+  for (const geometry_msgs::PoseStamped& pose : transformed_plan)
   {
     // Transform potential target pose into base_link
-    geometry_msgs::PoseStamped transformed_pose;
-    tf2::doTransform(pose, transformed_pose, costmap_to_robot);
+    Pose2D plan_pose = { pose.pose.position.x, pose.pose.position.y, tf2::getYaw(pose.pose.orientation) };
+    Pose2D transformed_pose = costmap_to_robot_2d.apply(plan_pose);
+    transformed_pose.theta = angles::normalize_angle(transformed_pose.theta);
     target_poses.push_back(transformed_pose);
   }
   computeDistanceAlongPath(target_poses, target_distances);
 
-  // Work back from the end of plan to find valid target pose
-  for (int i = transformed_plan.size() - 1; i >= 0; --i)
+  // Velocity caps to simulate each target pose with, fastest first
+  std::vector<double>& velocity_caps = velocity_caps_;
+  velocity_caps.clear();
+  double sim_velocity = max_vel_x;
+  do
+  {
+    velocity_caps.push_back(sim_velocity);
+    sim_velocity -= scaling_step_;
+  }
+  while (sim_velocity >= scaling_vel_x_);
+
+  // Configure controller velocity limits, max_abs_velocity is set per cap
+  VelocityLimits limits;
+  limits.min_abs_velocity = min_vel_x_;
+  limits.max_abs_velocity = max_vel_x;
+  limits.max_abs_angular_velocity = max_vel_theta_limited_;
+
+  // Simulation of this cycle, shared by every target pose
+  RolloutParameters params;
+  params.resolution = resolution_;
+  params.initial_rotate_tolerance = initial_rotate_tolerance_;
+  params.max_vel_theta = getMaxRotationVelocity();
+  params.min_in_place_vel_theta = min_in_place_vel_theta_;
+  params.acc_lim_theta = acc_lim_theta_;
+  // NOTE: max_vel_x_ is possibly changing from ROS topic
+  params.max_vel_x = max_vel_x_;
+  params.scaling_vel_x = scaling_vel_x_;
+  params.scaling_factor = scaling_factor_;
+  params.incremental_rotation = incremental_rotation_;
+  params.lazy_collision_checking = lazy_collision_checking_;
+  if (arc_integration_)
+  {
+    params.integrator = RolloutIntegrator::ARC;
+    params.max_step_length = max_step_length_;
+    params.max_heading_error = max_heading_error_;
+    // Largest footprint, after scaling at max velocity
+    params.footprint_radius = costmap_ros_->getLayeredCostmap()->getCircumscribedRadius() *
+                              (1.0 + std::max(0.0, scaling_factor_));
+  }
+  if (rollout_cache_ && !sameParameters(params, rollout_cache_params_))
+  {
+    // Cached trajectories were simulated differently
+    rollout_cache_->clear();
+    rollout_cache_params_ = params;
+  }
+  GracefulRollout rollout(controller_, params);
+  rollout_params_ = params;
+
+  // Simulated poses are in the base frame, collision check them in the costmap.
+  // Visualization is left to publishRollout(), which only shows the winner.
+  // Footprints in open space are accepted from the cost pyramid, if any. Otherwise
+  // the footprint templates, if any, answer for the scalings they were built for,
+  // through the summed area table of the costmap if there is one.
+  costmap_2d::Costmap2D* costmap = costmap_ros_->getCostmap();
+  CostGrid grid = { costmap->getCharMap(), costmap->getSizeInCellsX(), costmap->getSizeInCellsY(),
+                    costmap->getResolution(), costmap->getOriginX(), costmap->getOriginY() };
+  const CostPyramid* pyramid = cost_pyramid_.get();
+  if (pyramid)
+  {
+    cost_pyramid_->update(grid);
+  }
+  double radius = costmap_ros_->getLayeredCostmap()->getCircumscribedRadius();
+  const FootprintTemplates* templates = footprint_templates_.get();
+  const OccupancyIntegral* integral = nullptr;
+  if (templates && footprint_integral_)
+  {
+    occupancy_integral_.update(grid);
+    integral = &occupancy_integral_;
+  }
+  CollisionChecker is_colliding = [this, grid, pyramid, radius, templates, integral](const Pose2D& pose,
+                                                                                    double footprint_scaling)
+  {
+    Pose2D costmap_pose = robot_to_costmap_.apply(pose);
+    if (pyramid && pyramid->isFree(costmap_pose.x, costmap_pose.y, radius * std::max(1.0, footprint_scaling)))
+    {
+      // Every cell the footprint can touch is below inscribed, so no check can collide
+      return false;
+    }
+    if (integral && footprint_scaling <= templates->getMaxScaling())
+    {
+      return integral->isColliding(*templates, costmap_pose.x, costmap_pose.y, costmap_pose.theta,
+                                   footprint_scaling);
+    }
+    if (templates && footprint_scaling <= templates->getMaxScaling())
+    {
+      return templates->isColliding(grid, costmap_pose.x, costmap_pose.y, costmap_pose.theta, footprint_scaling);
+    }
+    return isColliding(costmap_pose.x, costmap_pose.y, costmap_pose.theta, costmap_ros_, footprint_, NULL,
+                       footprint_scaling);
+  };
+
+  // One trajectory per velocity cap, grown only when there are more caps than before
+  for (RolloutStorage& storage : rollout_storage_)
   {
-    // Underlying control law needs a single target pose, which should:
-    //  * Be as far away as possible from the robot (for smoothness)
-    //  * But no further than the max_lookahed_ distance
-    //  * Be feasible to reach in a collision free manner
-    geometry_msgs::PoseStamped target_pose = target_poses[i];
-    double dist_to_target = target_distances[i];
+    reserveStorage(storage, velocity_caps.size());
+  }
 
-    // Continue if target_pose is too far away from robot
-    if (dist_to_target > max_lookahead_)
+  // Underlying control law needs a single target pose, which should:
+  //  * Be as far away as possible from the robot (for smoothness)
+  //  * But no further than the max_lookahed_ distance
+  //  * Be feasible to reach in a collision free manner
+  auto isCandidate = [&](int i)
+  {
+    // Make sure target is far enough away to avoid instability
+    return target_distances[i] <= max_lookahead_ &&
+           (dist_to_goal < max_lookahead_ || target_distances[i] >= min_lookahead_);
+  };
+  auto targetPose = [&](int i)
+  {
+    Pose2D target_pose = target_poses[i];
+    if (dist_to_goal < max_lookahead_ && prefer_final_rotation_)
     {
-      continue;
+      // Avoid unstability and big sweeping turns at the end of paths by
+      // ignoring final heading
+      target_pose.theta = std::atan2(target_pose.y, target_pose.x);
     }
+    return target_pose;
+  };
 
-    if (dist_to_goal < max_lookahead_)
+  // How far along the plan the target was and the velocity cap that worked, for the next cycle
+  auto rememberTarget = [&](int i, size_t cap)
+  {
+    has_warm_start_ = true;
+    warm_start_distance_ = target_distances[i];
+    warm_start_cap_ = cap;
+  };
+
+  // Try to find a path to a pose of the plan, incrementally reducing the velocity
+  // from velocity_caps[first_cap]
+  search_targets_ = 0;
+  search_rollouts_ = 0;
+  search_evaluations_ = 0;
+  auto simulateTarget = [&](int i, size_t first_cap)
+  {
+    Pose2D target_pose = targetPose(i);
+    bool initial_rotation = has_new_path_;
+    size_t best = simulate(rollout, target_pose, limits, velocity_caps.data() + first_cap,
+                           velocity_caps.size() - first_cap, initial_rotation, is_colliding, rollout_storage_[0]);
+    if (!useRollout(target_pose, limits, initial_rotation, 0, first_cap, best, cmd_vel))
     {
-      if (prefer_final_rotation_)
+      return false;
+    }
+    rememberTarget(i, first_cap + best);
+    return true;
+  };
+
+  // Start with the pose as far along the plan as the target of the last cycle, so
+  // that the lookahead is kept while the robot drives, and its neighbours, farthest
+  // first. Caps start one faster than last time, so that the robot can still speed
+  // up. When the farthest of them is reachable and there are farther candidates, the
+  // target may have to move further than one pose, so all poses are searched.
+  // Usually this takes a single rollout.
+  int warm_failed_first = 0;
+  int warm_failed_last = -1;  // poses of the window that failed
+  size_t warm_first_cap = 0;
+  if (has_warm_start_)
+  {
+    int last = transformed_plan.size() - 1;
+    int warm_index = 0;
+    for (int i = last; i >= 0; --i)
+    {
+      if (target_distances[i] <= warm_start_distance_)
       {
-        // Avoid unstability and big sweeping turns at the end of paths by
-        // ignoring final heading
-        double yaw = std::atan2(target_pose.pose.position.y, target_pose.pose.position.x);
-        target_pose.pose.orientation.z = sin(yaw / 2.0);
-        target_pose.pose.orientation.w = cos(yaw / 2.0);
+        warm_index = i;
+        break;
       }
     }
-    else if (dist_to_target < min_lookahead_)
+    warm_first_cap = std::min(warm_start_cap_, velocity_caps.size() - 1);
+    if (warm_first_cap > 0)
+    {
+      --warm_first_cap;
+    }
+
+    bool farthest = true;
+    for (int i = std::min(warm_index + 1, last); i >= std::max(warm_index - 1, 0); --i)
     {
-      // Make sure target is far enough away to avoid instability
+      if (!isCandidate(i))
+      {
+        continue;
+      }
+      if (simulateTarget(i, warm_first_cap))
+      {
+        bool farther_candidate = false;
+        for (int j = i + 1; farthest && j <= last && !farther_candidate; ++j)
+        {
+          farther_candidate = isCandidate(j);
+        }
+        if (farther_candidate)
+        {
+          break;
+        }
+        reportSearch(true);
+        publishRollout(true, is_colliding);
+        return true;
+      }
+      farthest = false;
+      warm_failed_first = i;
+      warm_failed_last = std::max(warm_failed_last, i);
+    }
+  }
+
+  // Work back from the end of plan to find valid target pose
+  std::vector<int>& candidates = candidates_;
+  candidates.clear();
+  for (int i = transformed_plan.size() - 1; i >= 0; --i)
+  {
+    if (target_distances[i] > max_lookahead_)
+    {
+      // Too far away from robot
+      continue;
+    }
+    if (!isCandidate(i))
+    {
+      // Too close, and so are all of the poses before it
       break;
     }
+    if (warm_first_cap == 0 && i >= warm_failed_first && i <= warm_failed_last)
+    {
+      // Already simulated with every cap
+      continue;
+    }
+    candidates.push_back(i);
+  }
+
+  // Without a reachable target, the slowest rollout of the closest one is shown,
+  // like the sequential search does
+  auto showClosestTarget = [&](bool initial_rotation)
+  {
+    rollout_target_ = targetPose(candidates.back());
+    rollout_limits_ = limits;
+    rollout_limits_.max_abs_velocity = velocity_caps.back();
+    rollout_initial_rotation_ = initial_rotation;
+    rollout_storage_index_ = 0;
+    rollout_index_ = velocity_caps.size() - 1;
+  };
+
+  // The sequential search changes the initial rotation from one target to the next
+  // when the robot turns out to be aligned, and the cache is not thread safe
+  bool galloping = target_galloping_ && targets_monotone_ && candidates.size() > 1;
+  if (thread_pool_ && !galloping && !rollout_cache_ && !has_new_path_ && candidates.size() > 1)
+  {
+    // Each worker keeps its best rollout in one of its two storages, and simulates into the other
+    size_t count = velocity_caps.size();
+    std::fill(worker_best_.begin(), worker_best_.end(), candidates.size());
+    size_t first = findFirstSuccess(*thread_pool_, candidates.size(),
+                                    [&](size_t candidate, size_t worker, const std::atomic<size_t>& best)
+    {
+      size_t scratch = (worker_storage_[worker] == 1 + 2 * worker) ? 2 + 2 * worker : 1 + 2 * worker;
+      // Give up as soon as a farther target reached its goal
+      CollisionChecker cancellable = [&](const Pose2D& pose, double footprint_scaling)
+      {
+        return best.load(std::memory_order_relaxed) < candidate || is_colliding(pose, footprint_scaling);
+      };
+      size_t cap = simulate(rollout, targetPose(candidates[candidate]), limits, velocity_caps.data(), count, false,
+                            cancellable, rollout_storage_[scratch]);
+      if (cap == count)
+      {
+        return false;
+      }
+      worker_best_[worker] = candidate;
+      worker_storage_[worker] = scratch;
+      worker_best_cap_[worker] = cap;
+      return true;
+    });
 
-    // Iteratively try to find a path, incrementally reducing the velocity
-    double sim_velocity = max_vel_x;
-    do
+    if (first < candidates.size())
+    {
+      size_t worker = std::find(worker_best_.begin(), worker_best_.end(), first) - worker_best_.begin();
+      useRollout(targetPose(candidates[first]), limits, false, worker_storage_[worker], 0, worker_best_cap_[worker],
+                 cmd_vel);
+      rememberTarget(candidates[first], worker_best_cap_[worker]);
+      reportSearch(true);
+      publishRollout(true, is_colliding);
+      return true;
+    }
+    showClosestTarget(false);
+  }
+  else if (galloping)
+  {
+    // The best target so far (the farthest that passed) stays in its storage while the
+    // next one is simulated into the other, as the last target simulated is not
+    // necessarily the winner
+    size_t count = velocity_caps.size();
+    size_t spare = rollout_storage_.size() - 1;
+    size_t best_storage = 0;
+    size_t best_cap = count;
+    size_t best_candidate = candidates.size();
+    bool initial_rotation = has_new_path_;
+    bool monotone = true;
+    size_t first = gallopSearch(candidates.size(), target_galloping_verify_steps_, [&](size_t candidate)
     {
-      // Configure controller max velocity
-      controller_->setVelocityLimits(min_vel_x_, sim_velocity, max_vel_theta_limited_);
-      // Actually simulate our path
-      if (simulate(target_pose, cmd_vel))
+      size_t scratch = (best_storage == spare) ? 0 : spare;
+      size_t cap = simulate(rollout, targetPose(candidates[candidate]), limits, velocity_caps.data(), count,
+                            initial_rotation, is_colliding, rollout_storage_[scratch]);
+      if (cap == count)
+      {
+        return false;
+      }
+      if (candidate < best_candidate)
+      {
+        best_storage = scratch;
+        best_cap = cap;
+        best_candidate = candidate;
+      }
+      return true;
+    }, gallop_outcomes_, monotone);
+
+    if (!monotone)
+    {
+      // The gallop and the bisection skipped the target pose that was found
+      ROS_WARN("Reachable target poses are not contiguous along the path, searching one at a time");
+      targets_monotone_ = false;
+    }
+    if (first < candidates.size())
+    {
+      useRollout(targetPose(candidates[first]), limits, initial_rotation, best_storage, 0, best_cap, cmd_vel);
+      rememberTarget(candidates[first], best_cap);
+      reportSearch(true);
+      publishRollout(true, is_colliding);
+      return true;
+    }
+    showClosestTarget(initial_rotation);
+  }
+  else
+  {
+    for (int i : candidates)
+    {
+      if (simulateTarget(i, 0))
       {
         // Have valid command
+        reportSearch(true);
+        publishRollout(true, is_colliding);
         return true;
       }
-      // Reduce velocity and try again for same target_pose
-      sim_velocity -= scaling_step_;
     }
-    while (sim_velocity >= scaling_vel_x_);
+  }
+
+  // Search from scratch next time
+  has_warm_start_ = false;
+
+  if (search_targets_ > 0)
+  {
+    reportSearch(false);
+    // Show why the last target pose was not reachable
+    publishRollout(false, is_colliding);
   }
 
   ROS_ERROR("No pose in path was reachable");
   return false;
 }
 
-bool GracefulControllerROS::simulate(const geometry_msgs::PoseStamped& target_pose, geometry_msgs::Twist& cmd_vel)
+size_t GracefulControllerROS::simulate(const GracefulRollout& rollout, const Pose2D& target,
+                                       const VelocityLimits& limits, const double* max_velocities, size_t count,
+                                       bool initial_rotation, const CollisionChecker& is_colliding,
+                                       RolloutStorage& storage)
 {
-  // Simulated path (for debugging/visualization)
-  std::vector<geometry_msgs::PoseStamped> simulated_path;
-  // Should we simulate rotation initially
-  bool sim_initial_rotation_ = has_new_path_ && initial_rotate_tolerance_ > 0.0;
-  // Clear any previous visualizations
-  if (collision_points_)
+  size_t best = count;
+  if (!rollout_cache_ && !velocity_bisection_)
   {
-    collision_points_->markers.resize(0);
+    // Within the tolerance of the vectorized control law, the same cap as one at a time
+    best = rollout.simulateCaps(target, limits, max_velocities, count, initial_rotation, is_colliding,
+                                storage.trajectories.data(), storage.results.data());
   }
-  // Get control and path, iteratively
-  while (true)
+  else
   {
-    // The error between current robot pose and the target pose
-    geometry_msgs::PoseStamped error = target_pose;
-
-    // Extract error_angle
-    double error_angle = tf2::getYaw(error.pose.orientation);
-
-    // Move origin to our current simulated pose
-    if (!simulated_path.empty())
+    // Caps are simulated one at a time, through the cache if there is one
+    VelocityLimits cap_limits = limits;
+    std::function<bool(size_t)> reaches = [&](size_t i)
     {
-      double x = error.pose.position.x - simulated_path.back().pose.position.x;
-      double y = error.pose.position.y - simulated_path.back().pose.position.y;
-
-      double theta = -tf2::getYaw(simulated_path.back().pose.orientation);
-      error.pose.position.x = x * cos(theta) - y * sin(theta);
-      error.pose.position.y = y * cos(theta) + x * sin(theta);
+      cap_limits.max_abs_velocity = max_velocities[i];
+      if (rollout_cache_)
+      {
+        storage.results[i] = rollout_cache_->simulate(rollout, target, cap_limits, initial_rotation, is_colliding,
+                                                      control_cycle_, storage.trajectories[i]);
+      }
+      else
+      {
+        storage.results[i] = rollout.simulate(target, cap_limits, initial_rotation, is_colliding,
+                                              storage.trajectories[i]);
+      }
+      return storage.results[i].status == RolloutStatus::SUCCESS;
+    };
 
-      error_angle += theta;
-      error.pose.orientation.z = sin(error_angle / 2.0);
-      error.pose.orientation.w = cos(error_angle / 2.0);
+    if (velocity_bisection_)
+    {
+      // Caps skipped by the bisection are not reported
+      for (size_t i = 0; i < count; ++i)
+      {
+        storage.results[i].status = RolloutStatus::ABANDONED;
+      }
+      best = bisectCaps(count, bisection_verify_steps_, reaches);
     }
-
-    // Compute commands
-    double vel_x, vel_th;
-    if (sim_initial_rotation_)
+    else
     {
-      geometry_msgs::Twist rotation;
-      if (fabs(rotateTowards(error, rotation)) < initial_rotate_tolerance_)
+      // Fastest first
+      for (size_t i = 0; i < count; ++i)
       {
-        if (simulated_path.empty())
+        if (reaches(i))
         {
-          // Current robot pose satisifies initial rotate tolerance
-          ROS_WARN("Done rotating towards path");
-          has_new_path_ = false;
+          best = i;
+          break;
         }
-        sim_initial_rotation_ = false;
       }
-      vel_x = rotation.linear.x;
-      vel_th = rotation.angular.z;
     }
+    if (rollout_cache_)
+    {
+      ROS_DEBUG_THROTTLE(1.0, "Rollout cache: %zu hits, %zu misses", rollout_cache_->getHits(),
+                         rollout_cache_->getMisses());
+    }
+  }
 
-    if (!sim_initial_rotation_)
+  // Work done, for reportSearch(). Caps slower than the winner were abandoned or not run.
+  size_t rollouts = 0;
+  size_t evaluations = 0;
+  for (size_t i = 0; i < count && i <= best; ++i)
+  {
+    if (storage.results[i].status != RolloutStatus::ABANDONED)
     {
-      if (!controller_->approach(error.pose.position.x, error.pose.position.y, error_angle, vel_x, vel_th))
-      {
-        ROS_ERROR("Unable to compute approach");
-        return false;
-      }
+      ++rollouts;
+      evaluations += storage.results[i].evaluations;
     }
+  }
+  ++search_targets_;
+  search_rollouts_ += rollouts;
+  search_evaluations_ += evaluations;
+  return best;
+}
+
+bool GracefulControllerROS::useRollout(const Pose2D& target, const VelocityLimits& limits, bool initial_rotation,
+                                       size_t storage, size_t first_cap, size_t best, geometry_msgs::Twist& cmd_vel)
+{
+  const RolloutStorage& rollouts = rollout_storage_[storage];
+  size_t count = velocity_caps_.size() - first_cap;
+
+  if (rollouts.results[0].initially_aligned)
+  {
+    // Current robot pose satisifies initial rotate tolerance
+    ROS_WARN("Done rotating towards path");
+    has_new_path_ = false;
+  }
 
-    if (simulated_path.empty())
+  // Report why the faster caps failed
+  for (size_t i = 0; i < count && i <= best; ++i)
+  {
+    if (rollouts.results[i].status == RolloutStatus::NO_SOLUTION)
     {
-      // First iteration of simulation, store our commands to the robot
-      cmd_vel.linear.x = vel_x;
-      cmd_vel.angular.z = vel_th;
+      ROS_ERROR("Unable to compute approach");
     }
-    else if (std::hypot(error.pose.position.x, error.pose.position.y) < resolution_)
+    else if (rollouts.results[i].status == RolloutStatus::BUFFER_FULL)
     {
-      // We've simulated to the desired pose, can return this result
-      base_local_planner::publishPlan(simulated_path, local_plan_pub_);
-      target_pose_pub_.publish(target_pose);
-      // Publish visualization if desired
-      if (collision_points_)
-      {
-        collision_point_pub_.publish(*collision_points_);
-      }
-      return true;
+      ROS_DEBUG("Did not reach target_pose within %lu steps", rollouts.trajectories[i].capacity);
     }
+    // Collisions: reason will be printed in isColliding()
+  }
+
+  // Without a valid path, this is the command of the slowest cap
+  const RolloutResult& result = rollouts.results[std::min(best, count - 1)];
+  cmd_vel.linear.x = result.vel_x;
+  cmd_vel.angular.z = result.vel_th;
 
-    // Forward simulate command
-    geometry_msgs::PoseStamped next_pose;
-    next_pose.header.frame_id = costmap_ros_->getBaseFrameID();
-    if (simulated_path.empty())
+  // Remember the winner, so that it can be published
+  rollout_target_ = target;
+  rollout_limits_ = limits;
+  rollout_limits_.max_abs_velocity = velocity_caps_[first_cap + std::min(best, count - 1)];
+  rollout_initial_rotation_ = initial_rotation;
+  rollout_storage_index_ = storage;
+  rollout_index_ = std::min(best, count - 1);
+
+  return result.status == RolloutStatus::SUCCESS;
+}
+
+void GracefulControllerROS::reserveStorage(RolloutStorage& storage, size_t count)
+{
+  if (storage.trajectories.size() < count || (lazy_collision_checking_ && storage.footprint_scalings.empty()))
+  {
+    count = std::max(count, storage.trajectories.size());
+    storage.poses.resize(trajectory_capacity_ * count);
+    if (lazy_collision_checking_ || !storage.footprint_scalings.empty())
     {
-      // Initialize at origin
-      next_pose.pose.orientation.w = 1.0;
+      storage.footprint_scalings.resize(trajectory_capacity_ * count);
     }
-    else
+    storage.trajectories.clear();
+    for (size_t i = 0; i < count; ++i)
     {
-      // Start at last pose
-      next_pose = simulated_path.back();
-    }
-
-    // Generate next pose
-    double dt = (vel_x > 0.0) ? resolution_ / vel_x : 0.1;
-    double yaw = tf2::getYaw(next_pose.pose.orientation);
-    next_pose.pose.position.x += dt * vel_x * cos(yaw);
-    next_pose.pose.position.y += dt * vel_x * sin(yaw);
-    yaw += dt * vel_th;
-    next_pose.pose.orientation.z = sin(yaw / 2.0);
-    next_pose.pose.orientation.w = cos(yaw / 2.0);
-    simulated_path.push_back(next_pose);
-
-    // Compute footprint scaling
-    double footprint_scaling = 1.0;
-    if (vel_x > scaling_vel_x_)
-    {
-      // Scaling = (vel_x - scaling_vel_x) / (max_vel_x - scaling_vel_x)
-      // NOTE: max_vel_x_ is possibly changing from ROS topic
-      double ratio = max_vel_x_ - scaling_vel_x_;
-      // Avoid divide by zero
-      if (ratio > 0)
-      {
-        ratio = (vel_x - scaling_vel_x_) / ratio;
-        footprint_scaling += ratio * scaling_factor_;
-      }
+      double* footprint_scalings =
+          storage.footprint_scalings.empty() ? nullptr : &storage.footprint_scalings[i * trajectory_capacity_];
+      storage.trajectories.emplace_back(&storage.poses[i * trajectory_capacity_], trajectory_capacity_,
+                                        footprint_scalings);
     }
+    storage.results.resize(count);
+  }
+}
+
+void GracefulControllerROS::updateFootprint()
+{
+  // Comparing does not allocate, unlike Costmap2DROS::getRobotFootprint()
+  const std::vector<geometry_msgs::Point>& footprint = costmap_ros_->getLayeredCostmap()->getFootprint();
+  bool changed = footprint.size() != footprint_.size();
+  for (size_t i = 0; !changed && i < footprint.size(); ++i)
+  {
+    changed = footprint[i].x != footprint_[i].x || footprint[i].y != footprint_[i].y;
+  }
+  if (changed)
+  {
+    footprint_ = footprint;
+  }
 
-    // Check next pose for collision
-    tf2::doTransform(next_pose, next_pose, robot_to_costmap_transform_);
-    if (isColliding(next_pose.pose.position.x, next_pose.pose.position.y, tf2::getYaw(next_pose.pose.orientation),
-                    costmap_ros_, collision_points_, footprint_scaling))
+  // Templates are only used for polygon footprints, smaller ones check the center cell.
+  // Filled footprints and the summed area table are only checked with templates,
+  // which then default to 64 bins.
+  size_t yaw_bins = footprint_yaw_bins_;
+  if ((footprint_filled_ || footprint_integral_) && yaw_bins == 0)
+  {
+    yaw_bins = 64;
+  }
+  if (yaw_bins == 0 || footprint_.size() < 4)
+  {
+    footprint_templates_.reset();
+    return;
+  }
+
+  double resolution = costmap_ros_->getCostmap()->getResolution();
+  double max_scaling = 1.0 + std::max(0.0, scaling_factor_);
+  auto matches = [&](const FootprintTemplates& templates)
+  {
+    const std::vector<Point2D>& polygon = templates.getFootprint();
+    bool same = polygon.size() == footprint_.size();
+    for (size_t i = 0; same && i < polygon.size(); ++i)
+    {
+      same = polygon[i].x == footprint_[i].x && polygon[i].y == footprint_[i].y;
+    }
+    return same && templates.getResolution() == resolution && templates.getYawBins() == yaw_bins &&
+           templates.getScalingStep() == footprint_scaling_resolution_ && templates.getMaxScaling() >= max_scaling &&
+           templates.isFilled() == footprint_filled_;
+  };
+  if (footprint_templates_ && !matches(*footprint_templates_))
+  {
+    // Outdated, check the polygon until the new templates are built
+    footprint_templates_.reset();
+  }
+
+  // Many headings take a while to build, do not block the control loop. A build
+  // in progress is waited for, and dropped if it turns out outdated.
+  if (pending_footprint_templates_.valid())
+  {
+    if (pending_footprint_templates_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+      return;
+    }
+    std::unique_ptr<FootprintTemplates> templates = pending_footprint_templates_.get();
+    if (matches(*templates))
+    {
+      footprint_templates_ = std::move(templates);
+      ROS_INFO("Built %s footprint templates for %zu headings up to scaling %.2f (%zu bytes)",
+               footprint_filled_ ? "filled" : "boundary", yaw_bins, footprint_templates_->getMaxScaling(),
+               footprint_templates_->getSizeInBytes());
+    }
+  }
+  if (footprint_templates_)
+  {
+    return;
+  }
+
+  std::vector<Point2D> polygon(footprint_.size());
+  for (size_t i = 0; i < footprint_.size(); ++i)
+  {
+    polygon[i] = { footprint_[i].x, footprint_[i].y };
+  }
+  double scaling_step = footprint_scaling_resolution_;
+  bool filled = footprint_filled_;
+  pending_footprint_templates_ = std::async(std::launch::async, [polygon, resolution, yaw_bins, max_scaling,
+                                                                 scaling_step, filled]()
+  {
+    return std::unique_ptr<FootprintTemplates>(
+        new FootprintTemplates(polygon, resolution, yaw_bins, max_scaling, scaling_step, filled));
+  });
+}
+
+void GracefulControllerROS::reportSearch(bool success) const
+{
+  ROS_DEBUG("%s after %zu target poses, %zu rollouts and %zu control law evaluations",
+            success ? "Found a target pose" : "No target pose", search_targets_.load(), search_rollouts_.load(),
+            search_evaluations_.load());
+}
+
+void GracefulControllerROS::publishRollout(bool success, const CollisionChecker& is_colliding)
+{
+  const TrajectoryBuffer& trajectory = rollout_storage_[rollout_storage_index_].trajectories[rollout_index_];
+  const std::string& base_frame = costmap_ros_->getBaseFrameID();
+
+  if (success && local_plan_pub_.getNumSubscribers() > 0)
+  {
+    // Simulated path (for debugging/visualization)
+    std::vector<geometry_msgs::PoseStamped>& simulated_path = simulated_path_;
+    simulated_path.resize(trajectory.size);
+    for (size_t i = 0; i < trajectory.size; ++i)
+    {
+      simulated_path[i].header.frame_id = base_frame;
+      simulated_path[i].pose.position.x = trajectory.poses[i].x;
+      simulated_path[i].pose.position.y = trajectory.poses[i].y;
+      simulated_path[i].pose.orientation.z = sin(trajectory.poses[i].theta / 2.0);
+      simulated_path[i].pose.orientation.w = cos(trajectory.poses[i].theta / 2.0);
+    }
+    base_local_planner::publishPlan(simulated_path, local_plan_pub_);
+  }
+
+  if (success && target_pose_pub_.getNumSubscribers() > 0)
+  {
+    geometry_msgs::PoseStamped target_pose;
+    target_pose.header.frame_id = base_frame;
+    target_pose.pose.position.x = rollout_target_.x;
+    target_pose.pose.position.y = rollout_target_.y;
+    target_pose.pose.orientation.z = sin(rollout_target_.theta / 2.0);
+    target_pose.pose.orientation.w = cos(rollout_target_.theta / 2.0);
+    target_pose_pub_.publish(target_pose);
+  }
+
+  if (collision_points_ && collision_point_pub_.getNumSubscribers() > 0)
+  {
+    // The search does not record its collision checks, simulate the winner
+    // again (it is deterministic) with the checks of the search, which may be
+    // stricter than the polygon. The footprint polygon of each check is added
+    // to the markers, and the pose that the checks rejected, if any.
+    collision_points_->markers.resize(0);
+    CollisionChecker replay_checker = [this, &is_colliding](const Pose2D& pose, double footprint_scaling)
     {
-      // Publish visualization if desired
-      if (collision_points_)
+      Pose2D costmap_pose = robot_to_costmap_.apply(pose);
+      isColliding(costmap_pose.x, costmap_pose.y, costmap_pose.theta, costmap_ros_, footprint_, collision_points_,
+                  footprint_scaling);
+      if (is_colliding(pose, footprint_scaling))
       {
-        collision_point_pub_.publish(*collision_points_);
+        addPointMarker(costmap_pose.x, costmap_pose.y, true, collision_points_);
+        return true;
       }
-      // Reason will be printed in function
       return false;
-    }
+    };
+    GracefulRollout rollout(controller_, rollout_params_);
+    TrajectoryBuffer replay = rollout_storage_[rollout_storage_index_].trajectories[rollout_index_];
+    rollout.simulate(rollout_target_, rollout_limits_, rollout_initial_rotation_, replay_checker, replay);
+    collision_point_pub_.publish(*collision_points_);
   }
+}
 
-  // Really shouldn't hit this
-  ROS_ERROR("Did not reach target_pose, but stopped simulating?");
-  return false;
+size_t GracefulControllerROS::getBufferCapacity() const
+{
+  size_t capacity = transformed_plan_.capacity() * sizeof(geometry_msgs::PoseStamped) +
+                    target_poses_.capacity() * sizeof(Pose2D) +
+                    target_distances_.capacity() * sizeof(double) +
+                    velocity_caps_.capacity() * sizeof(double) +
+                    simulated_path_.capacity() * sizeof(geometry_msgs::PoseStamped) +
+                    footprint_.capacity() * sizeof(geometry_msgs::Point) +
+                    candidates_.capacity() * sizeof(int) +
+                    gallop_outcomes_.capacity() * sizeof(char);
+  for (const RolloutStorage& storage : rollout_storage_)
+  {
+    capacity += storage.poses.capacity() * sizeof(Pose2D) +
+                storage.footprint_scalings.capacity() * sizeof(double) +
+                storage.trajectories.capacity() * sizeof(TrajectoryBuffer) +
+                storage.results.capacity() * sizeof(RolloutResult);
+  }
+  return capacity;
 }
 
 bool GracefulControllerROS::isGoalReached()
@@ -729,6 +1359,7 @@ bool GracefulControllerROS::setPlan(const std::vector<geometry_msgs::PoseStamped
   {
     // Reset flags
     has_new_path_ = true;
+    targets_monotone_ = true;
     goal_tolerance_met_ = false;
     ROS_INFO("Recieved a new path with %lu points", filtered_plan.size());
     return true;
@@ -765,6 +1396,15 @@ double GracefulControllerROS::rotateTowards(const geometry_msgs::PoseStamped& po
 void GracefulControllerROS::rotateTowards(double yaw, geometry_msgs::Twist& cmd_vel)
 {
   // Determine max velocity based on current speed
+  double max_vel_th = getMaxRotationVelocity();
+
+  cmd_vel.linear.x = 0.0;
+  cmd_vel.angular.z = std::sqrt(2 * acc_lim_theta_ * fabs(yaw));
+  cmd_vel.angular.z = sign(yaw) * std::min(max_vel_th, std::max(min_in_place_vel_theta_, cmd_vel.angular.z));
+}
+
+double GracefulControllerROS::getMaxRotationVelocity()
+{
   double max_vel_th = max_vel_theta_limited_;
   if (!odom_helper_.getOdomTopic().empty())
   {
@@ -777,10 +1417,7 @@ void GracefulControllerROS::rotateTowards(double yaw, geometry_msgs::Twist& cmd_
     max_vel_th = std::min(max_vel_th, acc_limited);
     max_vel_th = std::max(max_vel_th, min_in_place_vel_theta_);
   }
-
-  cmd_vel.linear.x = 0.0;
-  cmd_vel.angular.z = std::sqrt(2 * acc_lim_theta_ * fabs(yaw));
-  cmd_vel.angular.z = sign(yaw) * std::min(max_vel_th, std::max(min_in_place_vel_theta_, cmd_vel.angular.z));
+  return max_vel_th;
 }
 
 void GracefulControllerROS::velocityCallback(const std_msgs::Float32::ConstPtr& max_vel_x)
@@ -797,6 +1434,18 @@ void GracefulControllerROS::velocityCallback(const std_msgs::Float32::ConstPtr&
 
 void computeDistanceAlongPath(const std::vector<geometry_msgs::PoseStamped>& poses,
                               std::vector<double>& distances)
+{
+  std::vector<Pose2D> poses_2d(poses.size());
+  for (size_t i = 0; i < poses.size(); ++i)
+  {
+    poses_2d[i].x = poses[i].pose.position.x;
+    poses_2d[i].y = poses[i].pose.position.y;
+    poses_2d[i].theta = 0.0;
+  }
+  computeDistanceAlongPath(poses_2d, distances);
+}
+
+void computeDistanceAlongPath(const std::vector<Pose2D>& poses, std::vector<double>& distances)
 {
   distances.resize(poses.size());
 
@@ -804,7 +1453,7 @@ void computeDistanceAlongPath(const std::vector<geometry_msgs::PoseStamped>& pos
   for (size_t i = 0; i < poses.size(); ++i)
   {
     // Determine distance from robot to pose
-    distances[i] = std::hypot(poses[i].pose.position.x, poses[i].pose.position.y);
+    distances[i] = std::hypot(poses[i].x, poses[i].y);
   }
 
   // Find the closest target pose
@@ -814,9 +1463,7 @@ void computeDistanceAlongPath(const std::vector<geometry_msgs::PoseStamped>& pos
   // Yes, the poses behind the robot will still use euclidean distance from robot, but we don't use those anyways
   for (size_t i = std::distance(std::begin(distances), closest) + 1; i < distances.size(); ++i)
   {
-    distances[i] = distances[i - 1] +
-                   std::hypot(poses[i].pose.position.x - poses[i - 1].pose.position.x,
-                              poses[i].pose.position.y - poses[i - 1].pose.position.y);
+    distances[i] = distances[i - 1] + std::hypot(poses[i].x - poses[i - 1].x, poses[i].y - poses[i - 1].y);
   }
 }
 
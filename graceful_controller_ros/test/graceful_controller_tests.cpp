@@ -47,7 +47,7 @@
 #include <tf2_ros/transform_broadcaster.h>
 #include <tf2/utils.h>
 
-// Only needed for computeDistanceAlongPath tests
+// Only needed for computeDistanceAlongPath and buffer tests
 #include <graceful_controller_ros/graceful_controller_ros.hpp>
 
 class ControllerFixture
@@ -451,6 +451,47 @@ TEST(ControllerTests, test_collision_check)
   EXPECT_FALSE(controller->computeVelocityCommands(command));
 }
 
+TEST(ControllerTests, test_rollout_buffers_reused)
+{
+  ControllerFixture fixture;
+  ASSERT_TRUE(fixture.setup());
+  boost::shared_ptr<nav_core::BaseLocalPlanner> controller = fixture.getController();
+  graceful_controller::GracefulControllerROS* graceful =
+      dynamic_cast<graceful_controller::GracefulControllerROS*>(controller.get());
+  ASSERT_TRUE(graceful != NULL);
+
+  std::vector<geometry_msgs::PoseStamped> plan;
+  geometry_msgs::PoseStamped pose;
+  pose.header.frame_id = "map";
+  pose.pose.orientation.w = 1.0;
+  for (double x = 0.1; x < 1.0; x += 0.05)
+  {
+    pose.pose.position.x = x;
+    pose.pose.position.y = 0.2 * x * x;
+    plan.push_back(pose);
+  }
+  EXPECT_TRUE(controller->setPlan(plan));
+  fixture.setSimVelocity(0.0, 0.0);
+  ros::Duration(0.25).sleep();
+
+  // The first cycles size the per-cycle storage
+  geometry_msgs::Twist command;
+  for (int i = 0; i < 3; ++i)
+  {
+    EXPECT_TRUE(controller->computeVelocityCommands(command));
+  }
+  size_t capacity = graceful->getBufferCapacity();
+  EXPECT_GT(capacity, 0u);
+
+  // After that, the same plan reuses the buffers rather than growing them. This
+  // does not count the allocations made elsewhere in a cycle.
+  for (int i = 0; i < 10; ++i)
+  {
+    EXPECT_TRUE(controller->computeVelocityCommands(command));
+    EXPECT_EQ(capacity, graceful->getBufferCapacity());
+  }
+}
+
 TEST(ControllerTests, test_compute_distance_along_path)
 {
   std::vector<geometry_msgs::PoseStamped> poses;